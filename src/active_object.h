@@ -0,0 +1,241 @@
+#ifndef _ACTIVE_OBJECT_H_
+#define _ACTIVE_OBJECT_H_
+
+/**
+ * C++17 required for compilation
+ * An object owning a LoopThread and a multi-producer single-consumer mailbox. Messages are handled one by one
+ * or in batches on the thread of the object, in the order they were posted. call() runs a function on that
+ * thread and returns a future of its result.
+ *
+ * The consumer sleeps without timeout while the mailbox is empty and takes every pending message with a single
+ * lock per wakeup, producers notify only when the consumer is actually sleeping.
+ *
+ * Example:
+ *
+ *      thread_utils::ActiveObject<Command> device("device");
+ *      device.start([&](Command& command) { driver.execute(command); });
+ *      ...any thread:
+ *      device.post(Command::reset());
+ *      std::future<Status> status = device.call([&]() { return driver.status(); });
+ *      ...
+ *      device.stop();//handles the messages posted before stop (ActiveObjectShutdown::Drain)
+ */
+
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+#include "loop_thread.h"
+#include "trace.h"
+
+namespace thread_utils
+{
+    /**
+     * What happens with the pending messages when an ActiveObject is stopped
+     */
+    enum class ActiveObjectShutdown
+    {
+        Drain,  //pending messages and calls are handled before the thread exits
+        Discard //pending messages are dropped, the futures of pending calls throw std::future_error (broken_promise)
+    };
+
+    template<typename Msg>
+    class ActiveObject
+    {
+    public:
+        typedef std::function<void (Msg& message)>                  handler_t;
+        typedef std::function<void (std::vector<Msg>& messages)>    batch_handler_t;
+
+        /**
+         * @param name Name of the thread
+         * @param shutdown Policy applied to the pending messages on stop(). Default value: Drain
+         */
+        explicit ActiveObject(const std::string& name, ActiveObjectShutdown shutdown = ActiveObjectShutdown::Drain)
+            : mMutex(), mCondition(), mMailbox(), mConsumerWaiting(false), mStopping(false)
+            , mShutdown(shutdown), mLoop(name)
+        {}
+        ActiveObject(const ActiveObject&) = delete;
+        ActiveObject& operator=(const ActiveObject&) = delete;
+        /**
+         * Stops the object, see stop()
+         */
+        ~ActiveObject() { stop(); }
+        /**
+         * Starts the thread of the object handling the messages one by one
+         * @return False is returned if the object is already running
+         */
+        bool start(const handler_t& handler)
+        {
+            return run([this, handler](std::vector<Envelope>& envelopes)
+            {
+                for(Envelope& envelope : envelopes)
+                {
+                    if( envelope.message ) { handler(*envelope.message); }
+                    else { envelope.call(); }
+                }
+            });
+        }
+        /**
+         * Starts the thread of the object handling the messages in batches of every message pending at a wakeup.
+         * Calls posted in between split the batch, so the order of messages and calls is preserved.
+         * @return False is returned if the object is already running
+         */
+        bool start(const batch_handler_t& handler)
+        {
+            return run([this, handler](std::vector<Envelope>& envelopes)
+            {
+                for(Envelope& envelope : envelopes)
+                {
+                    if( envelope.message )
+                    {
+                        mBatch.push_back(std::move(*envelope.message));
+                        continue;
+                    }
+                    flush(handler);
+                    envelope.call();
+                }
+                flush(handler);
+            });
+        }
+        /**
+         * Stops accepting messages and joins the thread after the pending messages are handled or dropped
+         * according to the shutdown policy. Must not be called from the thread of the object.
+         */
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> guard(mMutex);
+                if( mStopping ) { return; }
+                mStopping = true;
+            }
+            mCondition.notify_one();
+            if( mLoop.thread().joinable() ) { mLoop.thread().join(); }
+        }
+        /**
+         * Posts a message to the mailbox
+         * Copies the given value!
+         * @return False is returned if the object is stopping, the message is dropped then.
+         */
+        bool post(const Msg& message) { return deliver(Envelope(message)); }
+        /**
+         * Posts a message to the mailbox
+         * Moves the given value!
+         * @return False is returned if the object is stopping, the message is dropped then.
+         */
+        bool post(Msg&& message) { return deliver(Envelope(std::move(message))); }
+        /**
+         * Constructs a message in place in the mailbox
+         * @return False is returned if the object is stopping
+         */
+        template<typename... Args>
+        bool emplace(Args&&... args) { return deliver(Envelope(std::in_place, std::forward<Args>(args)...)); }
+        /**
+         * Runs the given function on the thread of the object, after the messages posted before it.
+         * @return Future of the result. If the object is stopping or discards the call on stop then the future
+         * throws std::future_error (broken_promise).
+         */
+        template<typename F>
+        std::future<std::invoke_result_t<std::decay_t<F>>> call(F&& function)
+        {
+            typedef std::invoke_result_t<std::decay_t<F>> result_t;
+            auto task = std::make_shared<std::packaged_task<result_t ()>>(std::forward<F>(function));
+            std::future<result_t> result = task->get_future();
+            deliver(Envelope(std::function<void ()>([task]() { (*task)(); })));
+            return result;
+        }
+        /**
+         * Returns the number of messages waiting in the mailbox (a snapshot)
+         */
+        size_t pending() const
+        {
+            std::lock_guard<std::mutex> guard(mMutex);
+            return mMailbox.size();
+        }
+
+        inline bool isRunning() const { return mLoop.isRunning(); }
+
+        inline Thread& thread() { return mLoop.thread(); }
+    private:
+        struct Envelope
+        {
+            std::optional<Msg>      message;
+            std::function<void ()>  call;
+
+            explicit Envelope(const Msg& _message) : message(_message), call() {}
+            explicit Envelope(Msg&& _message) : message(std::move(_message)), call() {}
+            template<typename... Args>
+            explicit Envelope(std::in_place_t, Args&&... args) : message(std::in_place, std::forward<Args>(args)...), call() {}
+            explicit Envelope(std::function<void ()>&& _call) : message(), call(std::move(_call)) {}
+        };
+
+        bool deliver(Envelope&& envelope)
+        {
+            bool wake = false;
+            {
+                std::lock_guard<std::mutex> guard(mMutex);
+                if( mStopping ) { return false; }
+                mMailbox.push_back(std::move(envelope));
+                wake = mConsumerWaiting;
+                mConsumerWaiting = false;
+            }
+            if( wake ) { mCondition.notify_one(); }
+            return true;
+        }
+
+        void flush(const batch_handler_t& handler)
+        {
+            if( mBatch.empty() ) { return; }
+            handler(mBatch);
+            mBatch.clear();
+        }
+
+        bool run(const std::function<void (std::vector<Envelope>& envelopes)>& dispatch)
+        {
+            {
+                std::lock_guard<std::mutex> guard(mMutex);
+                if( mLoop.isRunning() ) { return false; }
+                mStopping = false;
+            }
+            return mLoop.start([this, dispatch](std::atomic_bool&)
+            {
+                bool stopping = false;
+                mInbox.clear();
+                {
+                    std::unique_lock<std::mutex> guard(mMutex);
+                    while( mMailbox.empty() && !mStopping )
+                    {
+                        mConsumerWaiting = true;
+                        mCondition.wait(guard);
+                    }
+                    mConsumerWaiting = false;
+                    stopping = mStopping;
+                    if( !stopping || (mShutdown == ActiveObjectShutdown::Drain) ) { mInbox.swap(mMailbox); }
+                    else { mMailbox.clear(); }
+                }
+                THREAD_UTILS_TRACE_COUNTER("ActiveObject::batch", static_cast<int64_t>(mInbox.size()));
+                dispatch(mInbox);
+                mInbox.clear();
+                //the mailbox is closed once stopping, so the swap above took every remaining message
+                return !stopping;
+            });
+        }
+
+        mutable std::mutex          mMutex;
+        std::condition_variable     mCondition;
+        std::vector<Envelope>       mMailbox;
+        bool                        mConsumerWaiting;
+        bool                        mStopping;
+        const ActiveObjectShutdown  mShutdown;
+        std::vector<Envelope>       mInbox;//owned by the thread of the object
+        std::vector<Msg>            mBatch;//owned by the thread of the object
+        LoopThread                  mLoop;
+    };
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _ASYNC_WAITER_H_
+#define _ASYNC_WAITER_H_
+
+/**
+ * Building blocks shared by the coroutine aware primitives (see coroutine.h)
+ * Coroutine support is enabled only if the compiler provides C++20 coroutines,
+ * otherwise THREAD_UTILS_HAS_COROUTINES is left undefined and nothing changes for C++11 users.
+ */
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <chrono>
+#define THREAD_UTILS_HAS_COROUTINES 1
+#endif
+#endif
+
+namespace thread_utils
+{
+    namespace detail
+    {
+        /**
+         * Intrusive list node of a suspended (asynchronous) waiter.
+         * Nodes are stored inside the awaiting coroutine frame, therefore queuing and waking never allocates.
+         */
+        struct AsyncWaiter
+        {
+            AsyncWaiter*    next;
+            void            (*wake)(AsyncWaiter* waiter);
+            explicit AsyncWaiter(void (*wake_function)(AsyncWaiter*)) : next(nullptr), wake(wake_function) {}
+        };
+
+        /**
+         * FIFO of AsyncWaiter nodes. Not synchronized, it is guarded by the mutex of its owner.
+         */
+        class AsyncWaitList
+        {
+        private:
+            AsyncWaiter* mHead;
+            AsyncWaiter* mTail;
+        public:
+            AsyncWaitList() : mHead(nullptr), mTail(nullptr) {}
+
+            inline bool empty() const { return mHead == nullptr; }
+
+            inline void push_back(AsyncWaiter* waiter)
+            {
+                waiter->next = nullptr;
+                if( mTail ) { mTail->next = waiter; }
+                else        { mHead = waiter; }
+                mTail = waiter;
+            }
+            /**
+             * Removes and returns the first waiter
+             * @return nullptr is returned if the list is empty
+             */
+            inline AsyncWaiter* pop_front()
+            {
+                AsyncWaiter* waiter = mHead;
+                if( waiter )
+                {
+                    mHead = waiter->next;
+                    if( !mHead ) { mTail = nullptr; }
+                    waiter->next = nullptr;
+                }
+                return waiter;
+            }
+        };
+    }
+
+#ifdef THREAD_UTILS_HAS_COROUTINES
+    /**
+     * Resumes coroutines on its own thread(s). See Scheduler in coroutine.h
+     */
+    class Executor
+    {
+    public:
+        virtual ~Executor() {}
+        /**
+         * Queues a suspended coroutine to be resumed as soon as possible
+         */
+        virtual void post(std::coroutine_handle<> handle) = 0;
+        /**
+         * Queues a suspended coroutine to be resumed at the given monotonic time
+         */
+        virtual void post_at(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle) = 0;
+        /**
+         * Returns the executor running on the calling thread or nullptr
+         */
+        static Executor*& current()
+        {
+            static thread_local Executor* executor = nullptr;
+            return executor;
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * AsyncWaiter of a coroutine. The coroutine is resumed on the executor it was suspended from,
+         * or inline on the waking thread if it was not running on an executor.
+         */
+        struct CoroutineWaiter : public AsyncWaiter
+        {
+            std::coroutine_handle<> handle;
+            Executor*               executor;
+
+            CoroutineWaiter() : AsyncWaiter(&CoroutineWaiter::resume), handle(), executor(nullptr) {}
+
+            inline void suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                executor = Executor::current();
+            }
+
+            static void resume(AsyncWaiter* waiter)
+            {
+                //the waiter lives in the coroutine frame, do not touch it after resumption is initiated
+                CoroutineWaiter* self = static_cast<CoroutineWaiter*>(waiter);
+                std::coroutine_handle<> h = self->handle;
+                Executor* executor = self->executor;
+                if( executor )  { executor->post(h); }
+                else            { h.resume(); }
+            }
+        };
+    }
+#endif
+}
+
+#endif
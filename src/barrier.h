@@ -0,0 +1,258 @@
+#ifndef _BARRIER_H_
+#define _BARRIER_H_
+
+/**
+ * C++11 required for compilation, Linux only (futex)
+ * Header only phase synchronization primitives: Latch, Barrier and Phaser.
+ * Arrival is a single atomic read-modify-write on one counter, waiters spin briefly then sleep on a futex
+ * and the last arriver releases every waiter with a single wake.
+ *
+ * Example:
+ *
+ *      thread_utils::Barrier step_barrier(worker_count, [&world]() { world.swapBuffers(); });
+ *      ...every worker:
+ *      while(running)
+ *      {
+ *          simulate(my_part);
+ *          step_barrier.arrive_and_wait();//the last arriver swaps the buffers before anybody continues
+ *      }
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+#include "futex.h"
+
+namespace thread_utils
+{
+    /**
+     * Single use count down latch
+     */
+    class Latch final
+    {
+    public:
+        explicit Latch(uint32_t count) : mCount(count) {}
+        Latch(const Latch&) = delete;
+        Latch& operator=(const Latch&) = delete;
+        /**
+         * Decrements the counter, waiters are released when it reaches zero
+         * @param units Default value: 1
+         */
+        void count_down(uint32_t units = 1)
+        {
+            if( mCount.fetch_sub(units, std::memory_order_acq_rel) == units )
+            { detail::futexWakeAll(mCount); }
+        }
+        /**
+         * Returns true if the counter has reached zero
+         */
+        inline bool try_wait() const { return mCount.load(std::memory_order_acquire) == 0; }
+        /**
+         * Blocks until the counter reaches zero
+         */
+        void wait()
+        {
+            uint32_t count;
+            while( (count = mCount.load(std::memory_order_acquire)) != 0 )
+            { detail::spinThenWait(mCount, count); }
+        }
+        /**
+         * Decrements the counter then blocks until it reaches zero
+         */
+        void arrive_and_wait(uint32_t units = 1)
+        {
+            count_down(units);
+            wait();
+        }
+    private:
+        std::atomic<uint32_t> mCount;
+    };
+
+    /**
+     * Reusable barrier of a fixed number of parties. The completion function is run by the last arriving
+     * thread of each phase before the others are released.
+     * A party must not arrive again before the phase it arrived at has completed (see wait()).
+     */
+    class Barrier final
+    {
+    public:
+        /**
+         * @param parties Number of threads arriving in each phase
+         * @param completion Optional function run by the last arriver of each phase
+         */
+        explicit Barrier(uint32_t parties, const std::function<void ()>& completion = nullptr)
+            : mState(pack(parties, parties)), mPhase(0), mCompletion(completion) {}
+        Barrier(const Barrier&) = delete;
+        Barrier& operator=(const Barrier&) = delete;
+        /**
+         * Arrives without waiting
+         * @return The phase arrived at, pass it to wait()
+         */
+        uint32_t arrive()
+        {
+            uint32_t phase = mPhase.load(std::memory_order_acquire);
+            uint64_t state = mState.fetch_sub(1, std::memory_order_acq_rel) - 1;
+            if( remaining(state) == 0 ) { complete(state); }
+            return phase;
+        }
+        /**
+         * Blocks until the given phase is completed
+         */
+        void wait(uint32_t phase)
+        {
+            detail::spinThenWait(mPhase, phase);
+        }
+        /**
+         * Arrives and blocks until every party has arrived
+         */
+        void arrive_and_wait()
+        {
+            wait(arrive());
+        }
+        /**
+         * Arrives at the current phase and removes the caller from the parties of the following phases
+         */
+        void arrive_and_drop()
+        {
+            uint64_t state = mState.fetch_sub((uint64_t(1) << 32) + 1, std::memory_order_acq_rel) - ((uint64_t(1) << 32) + 1);
+            if( remaining(state) == 0 ) { complete(state); }
+        }
+        /**
+         * Returns the number of completed phases (wraps around)
+         */
+        inline uint32_t phase() const { return mPhase.load(std::memory_order_acquire); }
+    private:
+        static inline uint64_t pack(uint32_t parties, uint32_t remaining) { return (uint64_t(parties) << 32) | remaining; }
+        static inline uint32_t parties(uint64_t state)   { return static_cast<uint32_t>(state >> 32); }
+        static inline uint32_t remaining(uint64_t state) { return static_cast<uint32_t>(state); }
+
+        void complete(uint64_t state)
+        {
+            if( mCompletion ) { mCompletion(); }
+            //every party has arrived, nobody touches mState until the phase is advanced
+            mState.store(pack(parties(state), parties(state)), std::memory_order_relaxed);
+            mPhase.fetch_add(1, std::memory_order_release);
+            detail::futexWakeAll(mPhase);
+        }
+
+        std::atomic<uint64_t>   mState;//parties << 32 | remaining arrivals of the current phase
+        std::atomic<uint32_t>   mPhase;
+        std::function<void ()>  mCompletion;
+    };
+
+    /**
+     * Reusable barrier with dynamic membership. Parties can register and deregister at any phase.
+     * A party must not arrive again before the phase it arrived at has advanced (see await_advance()).
+     * The phase, the registered parties and the remaining arrivals are one atomic word, so every arrival and registration
+     * sees the phase it belongs to. Up to 2^20 - 1 parties, phases wrap around at 2^24.
+     */
+    class Phaser final
+    {
+    public:
+        /**
+         * @param parties Number of initially registered parties
+         */
+        explicit Phaser(uint32_t parties = 0) : mState(pack(0, parties, parties)), mPhase(0) {}
+        Phaser(const Phaser&) = delete;
+        Phaser& operator=(const Phaser&) = delete;
+        /**
+         * Adds a party to the current phase
+         * @return The current phase
+         */
+        uint32_t register_party()
+        {
+            uint64_t state = mState.load(std::memory_order_acquire);
+            while( !mState.compare_exchange_weak(state, pack(phaseOf(state), parties(state) + 1, remaining(state) + 1), std::memory_order_acq_rel) ) {}
+            return phaseOf(state);
+        }
+        /**
+         * Arrives without waiting
+         * @return The phase arrived at, pass it to await_advance()
+         */
+        uint32_t arrive() { return arrive(0); }
+        /**
+         * Arrives and removes the caller from the registered parties
+         * @return The phase arrived at
+         */
+        uint32_t arrive_and_deregister() { return arrive(1); }
+        /**
+         * Blocks until the given phase is completed
+         */
+        void await_advance(uint32_t phase)
+        {
+            for(uint32_t i = 0; i < 128; ++i)
+            {
+                if( advanced(mPhase.load(std::memory_order_acquire), phase) ) { return; }
+                detail::cpuRelax();
+            }
+            while( true )
+            {
+                uint32_t published = mPhase.load(std::memory_order_acquire);
+                if( advanced(published, phase) ) { return; }
+                detail::futexWait(mPhase, published);
+            }
+        }
+        /**
+         * Arrives and blocks until every registered party has arrived
+         */
+        void arrive_and_await_advance()
+        {
+            await_advance(arrive());
+        }
+        /**
+         * Returns the number of completed phases (wraps around at 2^24)
+         */
+        inline uint32_t phase() const { return phaseOf(mState.load(std::memory_order_acquire)); }
+        /**
+         * Returns the number of registered parties
+         */
+        inline uint32_t registered_parties() const { return parties(mState.load(std::memory_order_acquire)); }
+    private:
+        static const uint32_t PHASE_MASK = (1u << 24) - 1;
+        static const uint32_t COUNT_MASK = (1u << 20) - 1;
+
+        static inline uint64_t pack(uint32_t phase, uint32_t parties, uint32_t remaining)
+        { return (uint64_t(phase & PHASE_MASK) << 40) | (uint64_t(parties & COUNT_MASK) << 20) | (remaining & COUNT_MASK); }
+        static inline uint32_t phaseOf(uint64_t state)   { return static_cast<uint32_t>(state >> 40) & PHASE_MASK; }
+        static inline uint32_t parties(uint64_t state)   { return static_cast<uint32_t>(state >> 20) & COUNT_MASK; }
+        static inline uint32_t remaining(uint64_t state) { return static_cast<uint32_t>(state) & COUNT_MASK; }
+        /**
+         * True if the published phase is past the given one. The publication may lag behind the state, so a published
+         * phase behind the given one (the previous phase) is not past it.
+         */
+        static inline bool advanced(uint32_t published, uint32_t phase)
+        {
+            const uint32_t distance = (published - phase) & PHASE_MASK;
+            return (distance != 0) && (distance <= PHASE_MASK / 2);
+        }
+        /**
+         * The last arrival opens the next phase in the same atomic step, there is no intermediate state
+         */
+        uint32_t arrive(uint32_t deregister)
+        {
+            uint64_t state = mState.load(std::memory_order_acquire);
+            while( true )
+            {
+                const uint32_t phase = phaseOf(state);
+                const uint32_t left = parties(state) - deregister;
+                const bool last = (remaining(state) == 1);
+                const uint64_t next = last ? pack(phase + 1, left, left) : pack(phase, left, remaining(state) - 1);
+                if( mState.compare_exchange_weak(state, next, std::memory_order_acq_rel) )
+                {
+                    if( last )
+                    { //every phase is published once, the counter is advanced even if the publications overtake each other
+                        mPhase.fetch_add(1, std::memory_order_release);
+                        detail::futexWakeAll(mPhase);
+                    }
+                    return phase;
+                }
+            }
+        }
+
+        std::atomic<uint64_t> mState;//phase << 40 | parties << 20 | remaining arrivals of the current phase
+        std::atomic<uint32_t> mPhase;//published phase, the futex word of the waiters (counts every phase, compared modulo 2^24)
+    };
+}
+
+#endif
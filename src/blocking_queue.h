@@ -2,9 +2,14 @@
 #define _BLOCKING_QUEUE_H_
 
 #include "semaphore.h"
+#include "profiled_mutex.h"
+#include "trace.h"
+#include "pool_allocator.h"
 #include <queue>
 #include <mutex>
 #include <optional>
+#include <memory>
+#include <memory_resource>
 
 /**
  * Example: 
@@ -29,7 +34,7 @@
  *          //waits for a random number of milliseconds
  *          std::this_thread::sleep_for(std::chrono::duration<int64_t, std::milli>(std::experimental::randint<uint64_t>(100, 3000)));
  *          //add random data to queue
- *          data_queue.push(random_data);//or data_queue.emplace(random_data);
+ *          data_queue.push(random_data);//or data_queue.emplace_back(random_data);
  *      }
  *      is_running.store(false);
  *      if(th.joinable())
@@ -54,39 +59,127 @@
 
 namespace thread_utils
 {
-    template<typename T>
+    /**
+     * @tparam T Element type
+     * @tparam Allocator Allocator of the underlying std::deque, see PoolAllocator and pmr::BlockingQueue
+     */
+    template<typename T, typename Allocator = std::allocator<T>>
     class BlockingQueue
     {
     private:
-        std::mutex      mMutex;
-        std::deque<T>   mQueue;
+        ProfiledMutex               mMutex;
+        std::deque<T, Allocator>    mQueue;
         semaphore_t     mQueueSemaphore;
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        struct PopWaiter : public detail::CoroutineWaiter
+        {
+            std::optional<T> value;
+        };
+        detail::AsyncWaitList mAsyncWaiters;
+        /**
+         * Hands the element constructed from the given arguments over to a suspended coroutine if there is any
+         * @return False is returned if there was no waiting coroutine and the lock is still held
+         */
+        template<typename... Args>
+        bool handOver(std::unique_lock<ProfiledMutex>& locker, Args&&... args)
+        {
+            PopWaiter* waiter = static_cast<PopWaiter*>(mAsyncWaiters.pop_front());
+            if( !waiter ) { return false; }
+            waiter->value.emplace(std::forward<Args>(args)...);
+            locker.unlock();
+            waiter->wake(waiter);
+            return true;
+        }
+        /**
+         * Pops an element into the waiter if the queue is not empty, otherwise queues the waiter
+         * @return True is returned if an element was popped
+         */
+        bool pop_or_enqueue(PopWaiter* waiter)
+        {
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            if( mQueueSemaphore.try_wait() )
+            {
+                waiter->value.emplace(std::move(mQueue.front()));
+                mQueue.pop_front();
+                return true;
+            }
+            mAsyncWaiters.push_back(waiter);
+            return false;
+        }
+#endif
+        std::optional<T> take()
+        {
+            THREAD_UTILS_TRACE_INSTANT("BlockingQueue::pop");
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            //There is no need to check if the queue is empty thankfully to the semaphore.
+            std::optional<T> element(std::in_place, std::move(mQueue.front()));
+            mQueue.pop_front();
+            return element;
+        }
+
+        void takeInto(T& out)
+        {
+            THREAD_UTILS_TRACE_INSTANT("BlockingQueue::pop");
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            out = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+
+        template<typename... Args>
+        void insert(bool front, Args&&... args)
+        {
+            THREAD_UTILS_TRACE_INSTANT("BlockingQueue::push");
+            std::unique_lock<ProfiledMutex> guard(mMutex);
+#ifdef THREAD_UTILS_HAS_COROUTINES
+            if( handOver(guard, std::forward<Args>(args)...) ) { return; }
+#endif
+            if(front)   { mQueue.emplace_front(std::forward<Args>(args)...); }
+            else        { mQueue.emplace_back(std::forward<Args>(args)...); }
+            mQueueSemaphore.post();
+        }
     public:
-        BlockingQueue() {}
+        BlockingQueue() : mMutex("BlockingQueue") {}
+        /**
+         * @param profile_name Name of the lock profile of the queue (see profiled_mutex.h)
+         */
+        explicit BlockingQueue(const char* profile_name) : mMutex(profile_name) {}
+        /**
+         * @param allocator Allocator of the elements (e.g. a std::pmr::memory_resource* for pmr::BlockingQueue)
+         * @param profile_name Name of the lock profile of the queue (see profiled_mutex.h)
+         */
+        explicit BlockingQueue(const Allocator& allocator, const char* profile_name = "BlockingQueue")
+            : mMutex(profile_name), mQueue(allocator) {}
         /**
          * Push an element into the queue
          * Copies the given value!
          * @param element A const reference value of type T
          * @param front If true is given then the element is pushed to front instead of back
          */
-        void push(const T& element, bool front = false)
-        {
-            std::lock_guard<std::mutex> guard(mMutex);
-            if(front)   { mQueue.push_front(element); } 
-            else        { mQueue.push_back(element); }
-            mQueueSemaphore.post();
-        }
-         /**
-         * Emplace an element into the queue
-         * Moves the given value!
+        void push(const T& element, bool front = false) { insert(front, element); }
+        /**
+         * Push an element into the queue
+         * Moves the given value! Move-only types (e.g. std::unique_ptr) can be queued.
          * @param element An rvalue of type T
+         * @param front If true is given then the element is pushed to front instead of back
          */
-        void emplace(T&& element)
-        {
-            std::lock_guard<std::mutex> guard(mMutex);
-            mQueue.emplace(element);
-            mQueueSemaphore.post();
-        }
+        void push(T&& element, bool front = false) { insert(front, std::move(element)); }
+        /**
+         * Constructs an element in place at the back of the queue (or in a suspended async_pop() directly)
+         * @param args Arguments of a constructor of T
+         */
+        template<typename... Args>
+        void emplace_back(Args&&... args) { insert(false, std::forward<Args>(args)...); }
+        /**
+         * Constructs an element in place at the front of the queue
+         * @param args Arguments of a constructor of T
+         */
+        template<typename... Args>
+        void emplace_front(Args&&... args) { insert(true, std::forward<Args>(args)...); }
+        /**
+         * Same as emplace_back()
+         */
+        template<typename... Args>
+        void emplace(Args&&... args) { insert(false, std::forward<Args>(args)...); }
         /**
          * Pops and returns the last element. This function is blocking while there is no element in the queue.
          * @param timeout_ms The maximum amount of milliseconds to wait while the queue is empty. If the value is equal or
@@ -102,31 +195,198 @@ namespace thread_utils
             } else {
                 mQueueSemaphore.wait();
             }
-            std::lock_guard<std::mutex> guard(mMutex);
-            //There is no need to check if the queue is empty thankfully to the semaphore.
-            auto element = std::make_optional<T>(std::move(mQueue.front()));
-            mQueue.pop_front();
-            return element;
+            return take();
+        }
+        /**
+         * Pops and returns the first element. This function is blocking while there is no element in the queue
+         * until stop is requested on the given token.
+         * @param token Interrupts the wait if stop is requested
+         * @param timeout_ms The maximum amount of milliseconds to wait while the queue is empty. If the value is equal or
+         * lesser than 0 it will wait until an element arrives or stop is requested. Default value: -1
+         * @return If the given time has passed or stop was requested an std::nullopt is returned, otherwise a value of type T is returned.
+         */
+        std::optional<T> pop(const StopToken& token, int64_t timeout_ms = -1)
+        {
+            if( timeout_ms > 0 )
+            {
+                if( !mQueueSemaphore.wait_for(timeout_ms, token) )
+                { return std::nullopt; }
+            } else {
+                if( !mQueueSemaphore.wait(token) )
+                { return std::nullopt; }
+            }
+            return take();
+        }
+        /**
+         * Pops the first element into the given storage by move assignment, without constructing a std::optional.
+         * This function is blocking while there is no element in the queue.
+         * @param out Receives the element, left untouched on timeout
+         * @param timeout_ms The maximum amount of milliseconds to wait while the queue is empty. If the value is equal or
+         * lesser than 0 it will wait forever. Default value: -1
+         * @return False is returned if the given time has passed.
+         */
+        bool pop_into(T& out, int64_t timeout_ms = -1)
+        {
+            if( timeout_ms > 0 )
+            {
+                if( !mQueueSemaphore.wait_for(timeout_ms) )
+                { return false; }
+            } else {
+                mQueueSemaphore.wait();
+            }
+            takeInto(out);
+            return true;
+        }
+        /**
+         * Same as pop_into(out, timeout_ms) but returns false if stop is requested on the given token
+         */
+        bool pop_into(T& out, const StopToken& token, int64_t timeout_ms = -1)
+        {
+            if( timeout_ms > 0 )
+            {
+                if( !mQueueSemaphore.wait_for(timeout_ms, token) )
+                { return false; }
+            } else {
+                if( !mQueueSemaphore.wait(token) )
+                { return false; }
+            }
+            takeInto(out);
+            return true;
+        }
+        /**
+         * Pops the first element into @p out, blocking while the queue is empty until the given time has passed.
+         * Unlike pop_into(out, timeout_ms), a zero or negative duration does not wait forever but only polls the queue.
+         */
+        template<typename Rep, typename Period>
+        bool pop_into(T& out, const std::chrono::duration<Rep, Period>& timeout)
+        {
+            if( !mQueueSemaphore.wait_for(timeout) )
+            { return false; }
+            takeInto(out);
+            return true;
+        }
+        /**
+         * Pops and returns the first element. This function is blocking while there is no element in the queue
+         * until the given steady clock time is reached.
+         * @param deadline Absolute time, so a loop of waits does not accumulate drift
+         * @return If the deadline has passed an std::nullopt is returned, otherwise a value of type T is returned.
+         */
+        std::optional<T> pop_until(const std::chrono::steady_clock::time_point& deadline)
+        {
+            if( !mQueueSemaphore.wait_until(deadline) )
+            { return std::nullopt; }
+            return take();
+        }
+        /**
+         * Same as pop_until(deadline) but returns std::nullopt if stop is requested on the given token
+         */
+        std::optional<T> pop_until(const StopToken& token, const std::chrono::steady_clock::time_point& deadline)
+        {
+            if( !mQueueSemaphore.wait_until(deadline, token) )
+            { return std::nullopt; }
+            return take();
         }
+        /**
+         * Pops and returns the first element, blocking while the queue is empty until the given time has passed.
+         * Unlike pop(timeout_ms), a zero or negative duration does not wait forever but only polls the queue.
+         */
+        template<typename Rep, typename Period>
+        std::optional<T> pop(const std::chrono::duration<Rep, Period>& timeout)
+        { return pop_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        /**
+         * Same as pop(timeout) but returns std::nullopt if stop is requested on the given token.
+         * Unlike pop(token, timeout_ms), a zero or negative duration does not wait forever but only polls the queue.
+         */
+        template<typename Rep, typename Period>
+        std::optional<T> pop(const StopToken& token, const std::chrono::duration<Rep, Period>& timeout)
+        { return pop_until(token, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        /**
+         * Awaitable returned by async_pop()
+         */
+        class PopAwaiter
+        {
+        private:
+            BlockingQueue&  mQueue;
+            PopWaiter       mWaiter;
+        public:
+            explicit PopAwaiter(BlockingQueue& queue) : mQueue(queue), mWaiter() {}
+            bool await_ready() { return false; }
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                mWaiter.suspend(handle);
+                return !mQueue.pop_or_enqueue(&mWaiter);
+            }
+            T await_resume()
+            {
+                THREAD_UTILS_TRACE_INSTANT("BlockingQueue::pop");
+                return std::move(*mWaiter.value);
+            }
+        };
+        /**
+         * Suspends the calling coroutine while the queue is empty then pops the first element.
+         * Usage: T element = co_await queue.async_pop();
+         * A push() hands the element over to the first suspended coroutine directly.
+         */
+        PopAwaiter async_pop() { return PopAwaiter(*this); }
+#endif
         /**
          * Clears the queue
          */
         void clear()
         {
-            std::lock_guard<std::mutex> guard(mMutex);
+            std::lock_guard<ProfiledMutex> guard(mMutex);
             mQueue.clear();
         }
     };
 
+    /**
+     * BlockingQueue recycling its storage through per-thread caches, a steady-state queue does not allocate.
+     * See pool_allocator.h
+     */
+    template<typename T>
+    using PooledBlockingQueue = BlockingQueue<T, PoolAllocator<T>>;
+
+    namespace pmr
+    {
+        /**
+         * BlockingQueue allocating from a std::pmr::memory_resource
+         */
+        template<typename T>
+        using BlockingQueue = thread_utils::BlockingQueue<T, std::pmr::polymorphic_allocator<T>>;
+    }
+
     template<typename T>
     class BlockingSlot
     {
     private:
-        std::mutex          mMutex;
+        ProfiledMutex       mMutex;
         std::optional<T>    mSlot;
         binary_semaphore_t  mSemaphore;
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        struct GetWaiter : public detail::CoroutineWaiter
+        {
+            std::optional<T> value;
+        };
+        detail::AsyncWaitList mAsyncWaiters;
+        /**
+         * Copies the value into the waiter if the slot is set, otherwise queues the waiter
+         * @return True is returned if the value was copied
+         */
+        bool get_or_enqueue(GetWaiter* waiter)
+        {
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            if( mSemaphore.try_wait() )
+            {
+                waiter->value = mSlot;
+                return true;
+            }
+            mAsyncWaiters.push_back(waiter);
+            return false;
+        }
+#endif
     public:
-        BlockingSlot() : mMutex(), mSlot(std::nullopt), mSemaphore() {}
+        BlockingSlot() : mMutex("BlockingSlot"), mSlot(std::nullopt), mSemaphore() {}
         /**
          * Sets the given value to the slot
          * @param value
@@ -134,8 +394,17 @@ namespace thread_utils
          */
         bool set(const T& value)
         {
-            std::lock_guard<std::mutex> guard(mMutex);
+            std::unique_lock<ProfiledMutex> guard(mMutex);
             mSlot = value;
+#ifdef THREAD_UTILS_HAS_COROUTINES
+            if( GetWaiter* waiter = static_cast<GetWaiter*>(mAsyncWaiters.pop_front()) )
+            {
+                waiter->value = mSlot;
+                guard.unlock();
+                waiter->wake(waiter);
+                return true;
+            }
+#endif
             return mSemaphore.post();
         }
         /**
@@ -153,15 +422,97 @@ namespace thread_utils
                 if( !mSemaphore.wait_for(timeout_ms) )
                 { return std::nullopt; }
             }
-            std::lock_guard<std::mutex> guard(mMutex);
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            return mSlot;
+        }
+        /**
+         * Returns the value of the slot if set prevoiusly
+         * This function is blocking until the slot set, the given timeout expires or stop is requested on the given token
+         * @param token Interrupts the wait if stop is requested
+         * @param timeout_ms Timeout in millseconds. For an unlimited timeout, use value -1
+         * @return std::nullopt is returned on failure
+         */
+        std::optional<T> get(const StopToken& token, int64_t timeout_ms = -1)
+        {
+            if(timeout_ms < 0)
+            {
+                if( !mSemaphore.wait(token) )
+                { return std::nullopt; }
+            } else {
+                if( !mSemaphore.wait_for(timeout_ms, token) )
+                { return std::nullopt; }
+            }
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            return mSlot;
+        }
+        /**
+         * Returns the value of the slot if set prevoiusly
+         * This function is blocking until the slot set or the given steady clock time is reached
+         * @param deadline Absolute time
+         * @return std::nullopt is returned on failure
+         */
+        std::optional<T> get_until(const std::chrono::steady_clock::time_point& deadline)
+        {
+            if( !mSemaphore.wait_until(deadline) )
+            { return std::nullopt; }
+            std::lock_guard<ProfiledMutex> guard(mMutex);
+            return mSlot;
+        }
+        /**
+         * Same as get_until(deadline) but returns std::nullopt if stop is requested on the given token
+         */
+        std::optional<T> get_until(const StopToken& token, const std::chrono::steady_clock::time_point& deadline)
+        {
+            if( !mSemaphore.wait_until(deadline, token) )
+            { return std::nullopt; }
+            std::lock_guard<ProfiledMutex> guard(mMutex);
             return mSlot;
         }
+        /**
+         * Returns the value of the slot, blocking until the slot is set or the given time has passed.
+         * Unlike get(timeout_ms), a negative duration does not wait forever, zero and negative durations only poll.
+         */
+        template<typename Rep, typename Period>
+        std::optional<T> get(const std::chrono::duration<Rep, Period>& timeout)
+        { return get_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        /**
+         * Same as get(timeout) but returns std::nullopt if stop is requested on the given token.
+         * Unlike get(token, timeout_ms), a negative duration does not wait forever, zero and negative durations only poll.
+         */
+        template<typename Rep, typename Period>
+        std::optional<T> get(const StopToken& token, const std::chrono::duration<Rep, Period>& timeout)
+        { return get_until(token, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        /**
+         * Awaitable returned by async_get()
+         */
+        class GetAwaiter
+        {
+        private:
+            BlockingSlot&   mSlot;
+            GetWaiter       mWaiter;
+        public:
+            explicit GetAwaiter(BlockingSlot& slot) : mSlot(slot), mWaiter() {}
+            bool await_ready() { return false; }
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                mWaiter.suspend(handle);
+                return !mSlot.get_or_enqueue(&mWaiter);
+            }
+            std::optional<T> await_resume() { return std::move(mWaiter.value); }
+        };
+        /**
+         * Suspends the calling coroutine until the slot is set.
+         * Usage: auto value = co_await slot.async_get();
+         */
+        GetAwaiter async_get() { return GetAwaiter(*this); }
+#endif
         /**
          * Clears the slot
          */
         void clear()
         {
-            std::lock_guard<std::mutex> guard(mMutex);
+            std::lock_guard<ProfiledMutex> guard(mMutex);
             mSlot = std::nullopt;
         }
     };
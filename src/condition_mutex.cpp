@@ -8,11 +8,34 @@ thread_utils::ConditionMutex::ConditionMutex()
     , mWaitingThreadCount(0)
 {}
 
+thread_utils::ConditionMutex::ConditionMutex(const char* profile_name) : ConditionMutex()
+{
+#ifdef THREAD_UTILS_LOCK_PROFILING
+    mProbe.reset(new detail::LockProbe(profile_name));
+#else
+    (void)profile_name;
+#endif
+}
+
 thread_utils::ConditionMutex::~ConditionMutex()
 {}
 
 void thread_utils::ConditionMutex::lock()
 {
+#ifdef THREAD_UTILS_LOCK_PROFILING
+    if( mProbe )
+    {
+        if( !mMutex.try_lock() )
+        {
+            uint64_t begin = detail::LockProbe::now();
+            mMutex.lock();
+            mProbe->contended(detail::LockProbe::now() - begin, __builtin_return_address(0));
+        }
+        mProbe->acquired();
+        mState.store(true);
+        return;
+    }
+#endif
     mMutex.lock();
     mState.store(true);
 }
@@ -20,6 +43,9 @@ void thread_utils::ConditionMutex::lock()
 void thread_utils::ConditionMutex::unlock()
 {
     mState.store(false);
+#ifdef THREAD_UTILS_LOCK_PROFILING
+    if( mProbe ) { mProbe->releasing(); }
+#endif
     mMutex.unlock();
 }
 
@@ -27,6 +53,9 @@ bool thread_utils::ConditionMutex::try_lock()
 { 
     if( mMutex.try_lock() )
     {
+#ifdef THREAD_UTILS_LOCK_PROFILING
+        if( mProbe ) { mProbe->acquired(); }
+#endif
         mState.store(true);
         return true;
     } else {
@@ -39,7 +68,9 @@ void thread_utils::ConditionMutex::wait()
     std::unique_lock<std::mutex> locker(mMutex, std::adopt_lock);
     ++mWaitingThreadCount;
     mState.store(false);
+    releasing();
     mConditionVariable.wait(locker, [&] { return mSignal; });
+    acquired();
     mState.store(true);
     --mWaitingThreadCount;
     if( mWaitingThreadCount == 0 )
@@ -48,12 +79,18 @@ void thread_utils::ConditionMutex::wait()
 }
 
 bool thread_utils::ConditionMutex::wait_for(int64_t timeout_ms)
+{ 
+    return wait_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms));
+}
+
+bool thread_utils::ConditionMutex::wait_until(const std::chrono::steady_clock::time_point& deadline)
 { 
     std::unique_lock<std::mutex> locker(mMutex, std::adopt_lock);
     ++mWaitingThreadCount;
-    std::chrono::milliseconds ms{timeout_ms};
     mState.store(false);
-    bool waken = mConditionVariable.wait_for(locker, ms, [&] { return mSignal; });
+    releasing();
+    bool waken = mConditionVariable.wait_until(locker, deadline, [&] { return mSignal; });
+    acquired();
     mState.store(true);
     --mWaitingThreadCount;
     if( mWaitingThreadCount.load() == 0 )
@@ -62,6 +99,68 @@ bool thread_utils::ConditionMutex::wait_for(int64_t timeout_ms)
     return waken;
 }
 
+void thread_utils::ConditionMutex::stopNotify(void* arg)
+{
+    ConditionMutex* self = static_cast<ConditionMutex*>(arg);
+    { //a waiter checking the token under the lock has either seen the request or is already waiting
+        std::lock_guard<std::mutex> locker(self->mMutex);
+    }
+    self->mConditionVariable.notify_all();
+}
+
+bool thread_utils::ConditionMutex::wait(const StopToken& token)
+{
+    bool waken = false;
+    {
+        detail::StopNotifier notifier(token, &ConditionMutex::stopNotify, this);
+        std::unique_lock<std::mutex> locker(mMutex, std::adopt_lock);
+        ++mWaitingThreadCount;
+        mState.store(false);
+        releasing();
+        mConditionVariable.wait(locker, [&] { return mSignal || token.stop_requested(); });
+        acquired();
+        waken = mSignal;
+        mState.store(true);
+        --mWaitingThreadCount;
+        if( mWaitingThreadCount == 0 )
+        { mSignal = false; }
+        locker.release();
+        //the notifier is released unlocked because stopNotify() locks the mutex
+        unlock();
+    }
+    lock();
+    return waken;
+}
+
+bool thread_utils::ConditionMutex::wait_for(int64_t timeout_ms, const StopToken& token)
+{
+    return wait_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms), token);
+}
+
+bool thread_utils::ConditionMutex::wait_until(const std::chrono::steady_clock::time_point& deadline, const StopToken& token)
+{
+    bool waken = false;
+    {
+        detail::StopNotifier notifier(token, &ConditionMutex::stopNotify, this);
+        std::unique_lock<std::mutex> locker(mMutex, std::adopt_lock);
+        ++mWaitingThreadCount;
+        mState.store(false);
+        releasing();
+        mConditionVariable.wait_until(locker, deadline, [&] { return mSignal || token.stop_requested(); });
+        acquired();
+        waken = mSignal;
+        mState.store(true);
+        --mWaitingThreadCount;
+        if( mWaitingThreadCount.load() == 0 )
+        { mSignal = false; }
+        locker.release();
+        //the notifier is released unlocked because stopNotify() locks the mutex
+        unlock();
+    }
+    lock();
+    return waken;
+}
+
 void thread_utils::ConditionMutex::notify_one()
 {
     if( !mState.load() )
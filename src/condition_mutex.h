@@ -6,6 +6,10 @@
 #include <condition_variable>
 #include <atomic>
 #include <chrono>
+#include <memory>
+
+#include "stop_token.h"
+#include "profiled_mutex.h"
 
 namespace thread_utils
 {
@@ -13,6 +17,12 @@ namespace thread_utils
     {
     public:
         ConditionMutex();
+        /**
+         * Records the contention of the underlying mutex under the given name if THREAD_UTILS_LOCK_PROFILING
+         * is defined. See profiled_mutex.h
+         * @param profile_name
+         */
+        explicit ConditionMutex(const char* profile_name);
         ~ConditionMutex();
         /**
          * Lock the underlying mutex.
@@ -37,6 +47,43 @@ namespace thread_utils
          * @return False is returned if it is not waken up before the given timeout expired. If the condition variable is woken up true is returned.
          */
         bool wait_for(int64_t timeout_ms);
+        /**
+         * Block the current thread until the condition variable is woken up or stop is requested on the given token.
+         * Stop must not be requested by a thread holding this mutex.
+         * @param token
+         * @return False is returned if stop was requested before the condition variable was woken up.
+         */
+        bool wait(const StopToken& token);
+        /**
+         * Block the current thread until the condition variable is woken up, stop is requested on the given token or
+         * after the specified timeout duration
+         * @param timeout_ms - Block the current thread for at least this time in milliseconds.
+         * @param token
+         * @return False is returned if it is not waken up before the given timeout expired or stop was requested.
+         */
+        bool wait_for(int64_t timeout_ms, const StopToken& token);
+        /**
+         * Block the current thread until the condition variable is woken up or the given steady clock time is reached
+         * @param deadline - absolute time, waking up early and waiting again does not accumulate drift
+         * @return False is returned if it is not waken up before the deadline.
+         */
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline);
+        /**
+         * Same as wait_until(deadline) but also returns false if stop is requested on the given token
+         */
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline, const StopToken& token);
+        /**
+         * Same as wait_for(timeout_ms) with a std::chrono duration of any precision
+         */
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        /**
+         * Same as wait_for(timeout_ms, token) with a std::chrono duration of any precision
+         */
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout, const StopToken& token)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout), token); }
         /**
          * Wake one blocking thread
          */
@@ -46,11 +93,31 @@ namespace thread_utils
          */
         void notify_all();
     private:
+        static void stopNotify(void* arg);
+        /**
+         * Profiling hooks around the implicit unlock and relock of the condition variable waits
+         */
+        inline void releasing()
+        {
+#ifdef THREAD_UTILS_LOCK_PROFILING
+            if( mProbe ) { mProbe->releasing(); }
+#endif
+        }
+        inline void acquired()
+        {
+#ifdef THREAD_UTILS_LOCK_PROFILING
+            if( mProbe ) { mProbe->acquired(); }
+#endif
+        }
+
         mutable std::mutex      mMutex;
         std::condition_variable mConditionVariable;
         bool                    mSignal;
         std::atomic_bool        mState;
         std::atomic<uint32_t>   mWaitingThreadCount;
+#ifdef THREAD_UTILS_LOCK_PROFILING
+        std::unique_ptr<detail::LockProbe> mProbe;
+#endif
     };
 }
 
@@ -0,0 +1,235 @@
+#ifndef _THREAD_UTILS_COROUTINE_H_
+#define _THREAD_UTILS_COROUTINE_H_
+
+/**
+ * C++20 required for compilation
+ * Coroutine scheduler running on LoopThreads. Thousands of coroutines can wait on
+ * BlockingQueue::async_pop(), BlockingSlot::async_get() or Semaphore::async_acquire() while
+ * only the scheduler threads exist.
+ *
+ * Example:
+ *
+ *      thread_utils::BlockingQueue<uint64_t> data_queue;
+ *      thread_utils::Scheduler scheduler("scheduler", 2);
+ *
+ *      auto consumer = [&data_queue]() -> thread_utils::Task
+ *      {
+ *          while(true)
+ *          {
+ *              uint64_t data = co_await data_queue.async_pop();
+ *              printf("New data: %lu\n", data);
+ *              co_await thread_utils::asyncSleepFor(100);
+ *          }
+ *      };
+ *      for(size_t i = 0; i < 1000; ++i) { scheduler.spawn(consumer()); }
+ *      scheduler.start();
+ *      ...
+ *      data_queue.push(42);
+ */
+
+#include "async_waiter.h"
+
+#ifdef THREAD_UTILS_HAS_COROUTINES
+
+#include <stdint.h>
+#include <exception>
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "loop_thread.h"
+
+namespace thread_utils
+{
+    /**
+     * Fire and forget coroutine type. The coroutine starts suspended and runs after it is passed to Scheduler::spawn().
+     * Its frame is released when the coroutine finishes.
+     */
+    class Task final
+    {
+    public:
+        struct promise_type
+        {
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        Task(Task&& other) noexcept : mHandle(other.mHandle) { other.mHandle = nullptr; }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() { if( mHandle ) { mHandle.destroy(); } }
+        /**
+         * Releases the ownership of the coroutine frame
+         */
+        std::coroutine_handle<> release()
+        {
+            std::coroutine_handle<> handle = mHandle;
+            mHandle = nullptr;
+            return handle;
+        }
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle) : mHandle(handle) {}
+        std::coroutine_handle<promise_type> mHandle;
+    };
+
+    class Scheduler final : public Executor
+    {
+    private:
+        struct Timer
+        {
+            std::chrono::steady_clock::time_point   deadline;
+            std::coroutine_handle<>                 handle;
+            bool operator>(const Timer& other) const { return deadline > other.deadline; }
+        };
+
+        const std::string                                                   mName;
+        const uint32_t                                                      mThreadCount;
+        std::mutex                                                          mMutex;
+        std::condition_variable                                             mConditionVariable;
+        std::deque<std::coroutine_handle<>>                                 mReady;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> mTimers;
+        std::vector<std::unique_ptr<LoopThread>>                            mThreads;
+
+        bool runOnce(std::atomic_bool& is_running)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> locker(mMutex);
+                while( true )
+                {
+                    if( !is_running.load() ) { return false; }
+                    auto now = std::chrono::steady_clock::now();
+                    while( !mTimers.empty() && (mTimers.top().deadline <= now) )
+                    {
+                        mReady.push_back(mTimers.top().handle);
+                        mTimers.pop();
+                    }
+                    if( !mReady.empty() )
+                    {
+                        handle = mReady.front();
+                        mReady.pop_front();
+                        break;
+                    }
+                    if( mTimers.empty() )   { mConditionVariable.wait(locker); }
+                    else                    { mConditionVariable.wait_until(locker, mTimers.top().deadline); }
+                }
+            }
+            handle.resume();
+            return true;
+        }
+    public:
+        /**
+         * @param name Name of the scheduler threads
+         * @param thread_count Number of LoopThreads resuming coroutines
+         */
+        Scheduler(const std::string& name, uint32_t thread_count = 1)
+            : mName(name), mThreadCount(thread_count > 0 ? thread_count : 1)
+            , mMutex(), mConditionVariable(), mReady(), mTimers(), mThreads()
+        {}
+        /**
+         * Stops and joins the scheduler threads. Coroutines not yet finished are leaked.
+         */
+        ~Scheduler() { stop(true); }
+        /**
+         * Starts the scheduler threads
+         * @return False is returned if the scheduler is already running
+         */
+        bool start()
+        {
+            if( !mThreads.empty() ) { return false; }
+            for(uint32_t i = 0; i < mThreadCount; ++i)
+            {
+                mThreads.emplace_back(new LoopThread(mName));
+                mThreads.back()->start([this](std::atomic_bool& is_running)
+                {
+                    Executor::current() = this;
+                    return runOnce(is_running);
+                });
+            }
+            return true;
+        }
+        /**
+         * Stops the scheduler threads
+         * @param wait If true is given the threads are joined
+         */
+        void stop(bool wait = false)
+        {
+            for(auto& thread : mThreads) { thread->stop(false); }
+            { //a thread checking its state under the lock has either seen the request or is already waiting
+                std::lock_guard<std::mutex> locker(mMutex);
+            }
+            mConditionVariable.notify_all();
+            if( wait )
+            {
+                for(auto& thread : mThreads) { thread->stop(true); }
+                mThreads.clear();
+            }
+        }
+        /**
+         * Transfers the ownership of a coroutine to the scheduler and queues it for execution
+         */
+        void spawn(Task&& task) { post(task.release()); }
+
+        void post(std::coroutine_handle<> handle) override
+        {
+            {
+                std::lock_guard<std::mutex> locker(mMutex);
+                mReady.push_back(handle);
+            }
+            mConditionVariable.notify_one();
+        }
+
+        void post_at(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle) override
+        {
+            {
+                std::lock_guard<std::mutex> locker(mMutex);
+                mTimers.push(Timer{deadline, handle});
+            }
+            //the earliest deadline might have changed, so waiters have to recompute it
+            mConditionVariable.notify_all();
+        }
+    };
+
+    /**
+     * Awaitable returned by asyncSleepFor()
+     */
+    class SleepAwaiter final
+    {
+    private:
+        std::chrono::steady_clock::time_point mDeadline;
+    public:
+        explicit SleepAwaiter(std::chrono::steady_clock::time_point deadline) : mDeadline(deadline) {}
+        bool await_ready() const { return std::chrono::steady_clock::now() >= mDeadline; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            Executor* executor = Executor::current();
+            if( executor )
+            {
+                executor->post_at(mDeadline, handle);
+                return true;
+            }
+            //not on an executor, there is nobody to resume the coroutine later
+            std::this_thread::sleep_until(mDeadline);
+            return false;
+        }
+        void await_resume() const {}
+    };
+    /**
+     * Suspends the calling coroutine for the given amount of time in milliseconds without blocking the scheduler thread.
+     * Usage: co_await asyncSleepFor(100);
+     * @param milliseconds
+     */
+    inline SleepAwaiter asyncSleepFor(int64_t milliseconds)
+    { return SleepAwaiter(std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds)); }
+}
+
+#endif
+
+#endif
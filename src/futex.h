@@ -0,0 +1,85 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/**
+ * Linux only. Thin wrappers around the futex system call on a 32 bit atomic word,
+ * used by the spin-then-sleep primitives (barrier.h, shared_mutex.h).
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+
+namespace thread_utils
+{
+    namespace detail
+    {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+        /**
+         * Sleeps while @p word equals @p expected, until woken or the optional relative timeout expires.
+         * May return spuriously, callers re-check their condition.
+         */
+        inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected, const struct timespec* timeout = nullptr)
+        {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+        }
+
+        /**
+         * Same as futexWait() with an absolute steady clock deadline
+         * @return False is returned if the deadline has passed without sleeping
+         */
+        inline bool futexWaitUntil(std::atomic<uint32_t>& word, uint32_t expected, const std::chrono::steady_clock::time_point& deadline)
+        {
+            const std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+            if( remaining.count() <= 0 ) { return false; }
+            struct timespec timeout;
+            timeout.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+            timeout.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+            futexWait(word, expected, &timeout);//relative timeouts of FUTEX_WAIT use the monotonic clock, like steady_clock
+            return true;
+        }
+
+        inline void futexWakeOne(std::atomic<uint32_t>& word)
+        {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        }
+
+        inline void futexWakeAll(std::atomic<uint32_t>& word)
+        {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+
+        inline void cpuRelax()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield" ::: "memory");
+#endif
+        }
+
+        /**
+         * Spins a bounded number of rounds then sleeps on the futex while @p word equals @p value
+         */
+        inline void spinThenWait(std::atomic<uint32_t>& word, uint32_t value, uint32_t spin_rounds = 128)
+        {
+            for(uint32_t i = 0; i < spin_rounds; ++i)
+            {
+                if( word.load(std::memory_order_acquire) != value ) { return; }
+                cpuRelax();
+            }
+            while( word.load(std::memory_order_acquire) == value )
+            {
+                futexWait(word, value);
+            }
+        }
+    }
+}
+
+#endif
@@ -2,45 +2,87 @@
 #define _LOOP_THREAD_H_
 
 #include <atomic>
+#include <memory>
 
 #include "thread.h"
+#include "watchdog.h"
 
 namespace thread_utils
 {
     class LoopThread
     {
     private:
-        std::atomic_bool    mIsRunning;
-        Thread              mThread;
+        std::atomic_bool            mIsRunning;
+        Thread                      mThread;
+        std::shared_ptr<Heartbeat>  mHeartbeat;
     public:
-        LoopThread(const std::string& name) : mIsRunning(false), mThread(name) {}
+        LoopThread(const std::string& name) : mIsRunning(false), mThread(name), mHeartbeat(std::make_shared<Heartbeat>(name)) {}
 
         inline bool start(const std::function<bool (std::atomic_bool& is_running)>& loop_function)
         {
             mIsRunning.store(true);
-            return mThread.run([loop_function, this]()
+            std::shared_ptr<Heartbeat> heartbeat = mHeartbeat;
+            return mThread.run([loop_function, heartbeat, this]()
             {
+                heartbeat->enter();
                 while(mIsRunning.load())
                 {
+                    heartbeat->beat();
                     if( !loop_function(mIsRunning) ) 
                     {
                         mIsRunning.store(false); 
                         break; 
                     }
                 }
-            });
+            }, [heartbeat]() { heartbeat->leave(); });
         }
 
+        /**
+         * Starts the loop. The given function receives the stop token of the thread, blocking calls waiting
+         * with it are interrupted by stop().
+         * @param loop_function Invoked repeatedly until it returns false or the loop is stopped
+         * @return False is returned if the loop thread is already running
+         */
+        inline bool start(const std::function<bool (const StopToken& token)>& loop_function)
+        {
+            mIsRunning.store(true);
+            std::shared_ptr<Heartbeat> heartbeat = mHeartbeat;
+            return mThread.run([loop_function, heartbeat, this]()
+            {
+                const StopToken token = currentStopToken();
+                heartbeat->enter();
+                while(mIsRunning.load())
+                {
+                    heartbeat->beat();
+                    if( !loop_function(token) ) 
+                    {
+                        mIsRunning.store(false); 
+                        break; 
+                    }
+                }
+            }, [heartbeat]() { heartbeat->leave(); });
+        }
+        /**
+         * Stops the loop and requests stop on the thread, so waits on its stop token return promptly
+         * @param wait If true is given then the thread is joined
+         */
         inline void stop(bool wait = false)
         {
             mIsRunning.store(false);
+            mThread.requestStop();
             if( wait ) 
             { mThread.join(); }
         }
 
         inline bool isRunning() const { return mIsRunning.load(); }
 
+        inline StopToken stopToken() const { return mThread.stopToken(); }
+
         inline Thread& thread() { return mThread; }
+        /**
+         * Returns the heartbeat of the loop, bumped at the start of every iteration. See Watchdog
+         */
+        inline const std::shared_ptr<Heartbeat>& heartbeat() const { return mHeartbeat; }
     };
 }
 
@@ -0,0 +1,211 @@
+#ifndef _POOL_ALLOCATOR_H_
+#define _POOL_ALLOCATOR_H_
+
+/**
+ * C++11 required for compilation
+ * Header only allocator recycling fixed-size blocks through per-thread caches.
+ *
+ * Allocations are rounded up to power of two size classes (16 bytes - 64 KiB). Every thread keeps a small
+ * cache of free blocks per size class, so the blocks of a container oscillating around a steady size are reused
+ * without calling malloc. Blocks freed by another thread (e.g. a consumer releasing the blocks of a producer) overflow
+ * from the cache of that thread to a global list in batches and are picked up again by the allocating thread in batches.
+ * Pooled memory is kept for reuse and is not returned to the system. Larger allocations use operator new directly.
+ *
+ * Example:
+ *
+ *      thread_utils::PooledBlockingQueue<Message> queue;//BlockingQueue<Message, PoolAllocator<Message>>
+ *      std::vector<int, thread_utils::PoolAllocator<int>> values;
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+
+namespace thread_utils
+{
+    namespace detail
+    {
+        class NodePool final
+        {
+        public:
+            static const size_t MIN_SIZE_SHIFT = 4;
+            static const size_t MAX_SIZE_SHIFT = 16;
+            static const size_t SIZE_CLASSES = MAX_SIZE_SHIFT - MIN_SIZE_SHIFT + 1;
+            static const size_t BATCH = 32;
+
+            /**
+             * Returns the index of the size class of the given size or SIZE_CLASSES if the size is not pooled
+             */
+            static inline size_t sizeClass(size_t bytes)
+            {
+                size_t index = 0;
+                size_t size = size_t(1) << MIN_SIZE_SHIFT;
+                while( (size < bytes) && (index < SIZE_CLASSES) )
+                {
+                    size <<= 1;
+                    ++index;
+                }
+                return index;
+            }
+
+            static inline void* allocate(size_t bytes)
+            {
+                size_t index = sizeClass(bytes);
+                if( index >= SIZE_CLASSES ) { return ::operator new(bytes); }
+
+                ThreadCache& cache = threadCache(index);
+                if( !cache.head ) { global(index).refill(cache); }
+                if( !cache.head )
+                {
+                    systemAllocationCount().fetch_add(1, std::memory_order_relaxed);
+                    return ::operator new(blockSize(index));
+                }
+                Node* node = cache.head;
+                cache.head = node->next;
+                --cache.count;
+                return node;
+            }
+
+            static inline void deallocate(void* pointer, size_t bytes)
+            {
+                size_t index = sizeClass(bytes);
+                if( index >= SIZE_CLASSES )
+                {
+                    ::operator delete(pointer);
+                    return;
+                }
+                ThreadCache& cache = threadCache(index);
+                Node* node = static_cast<Node*>(pointer);
+                node->next = cache.head;
+                cache.head = node;
+                if( ++cache.count >= 2 * BATCH ) { global(index).release(cache, BATCH); }
+            }
+            /**
+             * Number of pooled blocks taken from operator new so far, stays constant once a workload reached its
+             * steady state
+             */
+            static inline uint64_t systemAllocations() { return systemAllocationCount().load(std::memory_order_relaxed); }
+        private:
+            struct Node
+            {
+                Node* next;
+            };
+
+            struct ThreadCache
+            {
+                Node*   head;
+                size_t  count;
+                ThreadCache() : head(nullptr), count(0) {}
+            };
+
+            /**
+             * Caches of a thread, returned to the global lists on thread exit
+             */
+            struct ThreadCaches
+            {
+                ThreadCache caches[SIZE_CLASSES];
+                ~ThreadCaches()
+                {
+                    for(size_t index = 0; index < SIZE_CLASSES; ++index)
+                    {
+                        if( caches[index].head ) { global(index).release(caches[index], caches[index].count); }
+                    }
+                }
+            };
+
+            /**
+             * Free blocks of one size class shared by every thread, guarded by a mutex taken once per batch
+             */
+            class GlobalList
+            {
+            private:
+                std::mutex  mMutex;
+                Node*       mHead;
+            public:
+                GlobalList() : mMutex(), mHead(nullptr) {}
+
+                void refill(ThreadCache& cache)
+                {
+                    std::lock_guard<std::mutex> guard(mMutex);
+                    while( mHead && (cache.count < BATCH) )
+                    {
+                        Node* node = mHead;
+                        mHead = node->next;
+                        node->next = cache.head;
+                        cache.head = node;
+                        ++cache.count;
+                    }
+                }
+
+                void release(ThreadCache& cache, size_t count)
+                {
+                    std::lock_guard<std::mutex> guard(mMutex);
+                    while( cache.head && count )
+                    {
+                        Node* node = cache.head;
+                        cache.head = node->next;
+                        node->next = mHead;
+                        mHead = node;
+                        --cache.count;
+                        --count;
+                    }
+                }
+            };
+
+            static inline size_t blockSize(size_t index) { return size_t(1) << (index + MIN_SIZE_SHIFT); }
+
+            static inline GlobalList& global(size_t index)
+            {
+                //never destroyed: thread caches may be flushed during static destruction
+                static GlobalList* lists = new GlobalList[SIZE_CLASSES];
+                return lists[index];
+            }
+
+            static inline std::atomic<uint64_t>& systemAllocationCount()
+            {
+                static std::atomic<uint64_t> count(0);
+                return count;
+            }
+
+            static inline ThreadCache& threadCache(size_t index)
+            {
+                static thread_local ThreadCaches thread_caches;
+                return thread_caches.caches[index];
+            }
+        };
+    }
+
+    /**
+     * Standard allocator backed by detail::NodePool. Every instance shares the same pool, so instances are always equal.
+     */
+    template<typename T>
+    class PoolAllocator
+    {
+    public:
+        typedef T value_type;
+
+        PoolAllocator() noexcept {}
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n)
+        {
+            static_assert(alignof(T) <= alignof(max_align_t), "over-aligned types are not supported by PoolAllocator");
+            return static_cast<T*>(detail::NodePool::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, size_t n) noexcept
+        {
+            detail::NodePool::deallocate(pointer, n * sizeof(T));
+        }
+    };
+
+    template<typename T, typename U>
+    inline bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return true; }
+    template<typename T, typename U>
+    inline bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return false; }
+}
+
+#endif
@@ -2,10 +2,19 @@
 #define _POSIX_SEMAPHORE_H_
 
 #include <stdint.h>
+#include <errno.h>
+#include <time.h>
 #include <semaphore.h>
+#include <mutex>
+#include <chrono>
 
 namespace thread_utils
 {
+    /**
+     * Every wait goes through one mutex: the waiter holding it takes its units one by one while the others queue behind
+     * it, so a multi-unit wait gets its units before any later waiter takes one and partly taken units are never starved.
+     * post() never blocks on the mutex.
+     */
     class PosixSemaphore final
     {
     public:
@@ -15,6 +24,12 @@ namespace thread_utils
          * Increments (unlocks) the semaphore.
          */
         inline void post()                          { sem_post(&mSemaphore); }
+        /**
+         * Increments (unlocks) the semaphore by the given units.
+         * POSIX semaphores can be incremented only by one, therefore this is @p units sem_post() calls. The value
+         * rises unit by unit, the serialized waiters take them in order.
+         */
+        inline void post(uint32_t units)            { while( units-- ) { sem_post(&mSemaphore); } }
         /**
          * Alias for post()
          */
@@ -29,17 +44,111 @@ namespace thread_utils
         inline int32_t value()                      { int val;sem_getvalue(&mSemaphore, &val);return val; }
         /**
          * Decrements (locks) the semaphore.
-         * If the semaphore currently has the value zero, then the call BLOCKS until either it 
-         * becomes possible to perform the decrement or a signal handler interrupts the call
+         * If the semaphore currently has the value zero, then the call BLOCKS until it becomes possible to
+         * perform the decrement
+         */
+        inline void wait()                          { wait(1); }
+        /**
+         * Decrements the semaphore by the given units, blocks until all of them are taken.
+         * Later waiters wait until this one has taken every unit.
+         * @param units
+         * @return False is returned if sem_wait fails with an error other than EINTR (nothing is taken then)
          */
-        inline void wait()                          { sem_wait(&mSemaphore); }
-        /* NOTE: wait_for() is not implemented because sem_timedwait requires absolute time 
-         * since the Epoch, 1970-01-01 00:00:00 +0000 (UTC). A sem_timedwait call may exit errno
-         * ETIMEDOUT earlier or later than it should if the system clock is adjusted ahead. 
+        bool wait(uint32_t units)
+        {
+            std::lock_guard<std::timed_mutex> guard(mWaitMutex);
+            for(uint32_t taken = 0; taken < units;)
+            {
+                if( sem_wait(&mSemaphore) == 0 ) { ++taken; }
+                else if( errno != EINTR )
+                {
+                    post(taken);
+                    return false;
+                }
+            }
+            return true;
+        }
+        /**
+         * Decrements the semaphore without blocking
+         * @return False is returned if the value of the semaphore was zero or another thread is waiting
+         */
+        inline bool try_wait()                      { return try_wait(1); }
+        /**
+         * Decrements the semaphore by the given units without blocking, all or nothing
+         * @param units
+         * @return False is returned if the units could not be taken or another thread is waiting (nothing is taken then)
          */
+        bool try_wait(uint32_t units)
+        {
+            std::unique_lock<std::timed_mutex> guard(mWaitMutex, std::try_to_lock);
+            if( !guard.owns_lock() ) { return false; }
+            //only the holder of the mutex decrements, so the value can only grow until the units are taken
+            if( value() < static_cast<int32_t>(units) ) { return false; }
+            for(uint32_t taken = 0; taken < units; ++taken)
+            {
+                if( sem_trywait(&mSemaphore) != 0 )
+                {
+                    post(taken);
+                    return false;
+                }
+            }
+            return true;
+        }
+        /**
+         * Decrements the semaphore, blocks until it is possible or after the specified timeout duration
+         * The timeout is measured on the monotonic clock (sem_clockwait), so adjusting the system clock does not affect it.
+         * @param timeout_ms - timeout in milliseconds
+         * @return False is returned if the given time has run out.
+         */
+        bool wait_for(int64_t timeout_ms)           { return wait_for(1, timeout_ms); }
+        /**
+         * Decrements the semaphore by the given units, blocks until all of them are taken or after the specified timeout duration.
+         * The timeout covers the time spent waiting behind other waiters. Nothing is taken on timeout.
+         * @param units
+         * @param timeout_ms - timeout in milliseconds
+         * @return False is returned if the given time has run out.
+         */
+        bool wait_for(uint32_t units, int64_t timeout_ms)
+        {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            std::unique_lock<std::timed_mutex> guard(mWaitMutex, std::defer_lock);
+            if( !guard.try_lock_until(deadline) ) { return false; }
+            const struct timespec monotonic_deadline = toTimespec(deadline);
+            for(uint32_t taken = 0; taken < units; ++taken)
+            {
+                if( !timedWait(monotonic_deadline) )
+                {
+                    post(taken);
+                    return false;
+                }
+            }
+            return true;
+        }
     private:
-        sem_t mSemaphore;
+        /**
+         * steady_clock is CLOCK_MONOTONIC on Linux
+         */
+        static struct timespec toTimespec(const std::chrono::steady_clock::time_point& deadline)
+        {
+            const std::chrono::nanoseconds since_epoch = deadline.time_since_epoch();
+            struct timespec result;
+            result.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+            result.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+            return result;
+        }
+
+        bool timedWait(const struct timespec& deadline)
+        {
+            while( true )
+            {
+                if( sem_clockwait(&mSemaphore, CLOCK_MONOTONIC, &deadline) == 0 ) { return true; }
+                if( errno != EINTR ) { return false; }
+            }
+        }
+
+        sem_t               mSemaphore;
+        std::timed_mutex    mWaitMutex;//serializes the waiters
     };
 }
 
-#endif
\ No newline at end of file
+#endif
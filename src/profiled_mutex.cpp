@@ -0,0 +1,200 @@
+#include "profiled_mutex.h"
+
+#ifdef THREAD_UTILS_LOCK_PROFILING
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <inttypes.h>
+
+static std::mutex& registryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::map<std::string, thread_utils::LockProfile*>& registry()
+{
+    //profiles are never destroyed, so locks and dumps are safe during static destruction
+    static std::map<std::string, thread_utils::LockProfile*>* profiles = new std::map<std::string, thread_utils::LockProfile*>();
+    return *profiles;
+}
+
+static inline uint32_t bucketOf(uint64_t ns)
+{
+    uint32_t bucket = (ns > 0) ? static_cast<uint32_t>(63 - __builtin_clzll(ns)) : 0;
+    return std::min(bucket, thread_utils::LockProfile::HISTOGRAM_BUCKETS - 1);
+}
+
+static uint64_t percentileOf(const std::atomic<uint64_t>* histogram, double percentile)
+{
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < thread_utils::LockProfile::HISTOGRAM_BUCKETS; ++i)
+    { total += histogram[i].load(std::memory_order_relaxed); }
+    if( total == 0 ) { return 0; }
+
+    uint64_t rank = static_cast<uint64_t>(percentile * static_cast<double>(total));
+    uint64_t count = 0;
+    for(uint32_t i = 0; i < thread_utils::LockProfile::HISTOGRAM_BUCKETS; ++i)
+    {
+        count += histogram[i].load(std::memory_order_relaxed);
+        if( count > rank ) { return (uint64_t(1) << (i + 1)); }
+    }
+    return (uint64_t(1) << thread_utils::LockProfile::HISTOGRAM_BUCKETS);
+}
+
+namespace thread_utils
+{
+
+LockProfile::LockProfile(const std::string& name)
+    : mName(name)
+    , mAcquisitions(0)
+    , mContended(0)
+    , mWaitNs(0)
+    , mHoldNs(0)
+    , mHoldSamples(0)
+{
+    reset();
+}
+
+double LockProfile::contentionRatio() const
+{
+    uint64_t acquired = acquisitions();
+    return (acquired > 0) ? (static_cast<double>(contended()) / static_cast<double>(acquired)) : 0.0;
+}
+
+std::vector<std::pair<const void*, uint64_t>> LockProfile::topCallSites() const
+{
+    std::vector<std::pair<const void*, uint64_t>> call_sites;
+    for(uint32_t i = 0; i < TRACKED_CALL_SITES; ++i)
+    {
+        const void* address = mCallSites[i].address.load(std::memory_order_relaxed);
+        if( address ) { call_sites.emplace_back(address, mCallSites[i].count.load(std::memory_order_relaxed)); }
+    }
+    std::sort(call_sites.begin(), call_sites.end(), [](const std::pair<const void*, uint64_t>& a, const std::pair<const void*, uint64_t>& b)
+    { return a.second > b.second; });
+    if( call_sites.size() > CALL_SITES ) { call_sites.resize(CALL_SITES); }
+    return call_sites;
+}
+
+uint64_t LockProfile::waitPercentile(double percentile) const
+{
+    return percentileOf(mWaitHistogram, percentile);
+}
+
+uint64_t LockProfile::holdPercentile(double percentile) const
+{
+    return percentileOf(mHoldHistogram, percentile);
+}
+
+void LockProfile::reset()
+{
+    mAcquisitions.store(0, std::memory_order_relaxed);
+    mContended.store(0, std::memory_order_relaxed);
+    mWaitNs.store(0, std::memory_order_relaxed);
+    mHoldNs.store(0, std::memory_order_relaxed);
+    mHoldSamples.store(0, std::memory_order_relaxed);
+    for(uint32_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        mWaitHistogram[i].store(0, std::memory_order_relaxed);
+        mHoldHistogram[i].store(0, std::memory_order_relaxed);
+    }
+    for(uint32_t i = 0; i < TRACKED_CALL_SITES; ++i)
+    {
+        mCallSites[i].address.store(nullptr, std::memory_order_relaxed);
+        mCallSites[i].count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LockProfile::recordWait(uint64_t wait_ns, const void* call_site, uint32_t weight)
+{
+    mContended.fetch_add(1, std::memory_order_relaxed);
+    mWaitNs.fetch_add(wait_ns, std::memory_order_relaxed);
+    mWaitHistogram[bucketOf(wait_ns)].fetch_add(1, std::memory_order_relaxed);
+    if( !call_site ) { return; }
+
+    const uint32_t hash = static_cast<uint32_t>((reinterpret_cast<uintptr_t>(call_site) >> 2) * 0x9E3779B97F4A7C15ull >> 32);
+    for(uint32_t i = 0; i < TRACKED_CALL_SITES; ++i)
+    {
+        CallSite& entry = mCallSites[(hash + i) % TRACKED_CALL_SITES];
+        const void* address = entry.address.load(std::memory_order_relaxed);
+        if( !address )
+        {//claim the free entry, somebody else might be faster
+            if( entry.address.compare_exchange_strong(address, call_site) )
+            { address = call_site; }
+        }
+        if( address == call_site )
+        {
+            entry.count.fetch_add(weight, std::memory_order_relaxed);
+            return;
+        }
+    }
+    //table full: the wait is only part of the totals and reported as 'elsewhere'
+}
+
+void LockProfile::recordHold(uint64_t hold_ns)
+{
+    mHoldNs.fetch_add(hold_ns, std::memory_order_relaxed);
+    mHoldSamples.fetch_add(1, std::memory_order_relaxed);
+    mHoldHistogram[bucketOf(hold_ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockProfile::dump(FILE* out) const
+{
+    uint64_t contended_count = contended();
+    uint64_t hold_samples = mHoldSamples.load(std::memory_order_relaxed);
+    fprintf(out, "lock '%s': acquisitions %" PRIu64 ", contended %" PRIu64 " (%.2f%%)\n",
+            mName.c_str(), acquisitions(), contended_count, contentionRatio() * 100.0);
+    fprintf(out, "    wait: total %" PRIu64 " ns, avg %" PRIu64 " ns, p50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns\n",
+            mWaitNs.load(std::memory_order_relaxed),
+            contended_count ? mWaitNs.load(std::memory_order_relaxed) / contended_count : 0,
+            waitPercentile(0.5), waitPercentile(0.99));
+    fprintf(out, "    hold: samples %" PRIu64 ", avg %" PRIu64 " ns, p50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns\n",
+            hold_samples, hold_samples ? mHoldNs.load(std::memory_order_relaxed) / hold_samples : 0,
+            holdPercentile(0.5), holdPercentile(0.99));
+
+    uint64_t reported = 0;
+    for(const auto& call_site : topCallSites())
+    {
+        fprintf(out, "    contended at %p: %" PRIu64 "\n", call_site.first, call_site.second);
+        reported += call_site.second;
+    }
+    if( contended_count > reported )
+    {//less contended and untracked call sites
+        fprintf(out, "    contended elsewhere: %" PRIu64 "\n", contended_count - reported);
+    }
+}
+
+LockProfile& LockProfiler::profile(const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(registryMutex());
+    auto& profiles = registry();
+    auto it = profiles.find(name);
+    if( it == profiles.end() )
+    {
+        it = profiles.emplace(name, new LockProfile(name)).first;
+    }
+    return *it->second;
+}
+
+void LockProfiler::dump(FILE* out)
+{
+    std::vector<const LockProfile*> profiles;
+    {
+        std::lock_guard<std::mutex> guard(registryMutex());
+        for(const auto& entry : registry()) { profiles.push_back(entry.second); }
+    }
+    std::sort(profiles.begin(), profiles.end(), [](const LockProfile* a, const LockProfile* b)
+    { return a->totalWaitNs() > b->totalWaitNs(); });
+    for(const auto* profile : profiles) { profile->dump(out); }
+}
+
+void LockProfiler::reset()
+{
+    std::lock_guard<std::mutex> guard(registryMutex());
+    for(auto& entry : registry()) { entry.second->reset(); }
+}
+
+}//thread_utils end
+
+#endif
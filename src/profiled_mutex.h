@@ -0,0 +1,256 @@
+#ifndef _PROFILED_MUTEX_H_
+#define _PROFILED_MUTEX_H_
+
+/**
+ * Contention profiling of locks.
+ *
+ * Profiling is compiled in only if THREAD_UTILS_LOCK_PROFILING is defined for every translation unit
+ * (e.g. -DTHREAD_UTILS_LOCK_PROFILING). Otherwise ProfiledMutex is a plain std::mutex wrapper without any overhead.
+ *
+ * Every ProfiledMutex reports to the LockProfile registered under its name, so e.g. the mutexes of all
+ * BlockingQueue instances are aggregated under "BlockingQueue". A profile records:
+ *  - acquisitions and contended acquisitions (contention ratio)
+ *  - wait time histogram of contended acquisitions
+ *  - hold time histogram (sampled, see LockProfiler::setSampleRate())
+ *  - the most contended call sites (sampled like hold time, return addresses, resolve them with addr2line)
+ *
+ * Example:
+ *
+ *      thread_utils::ProfiledMutex table_mutex("table");
+ *      {
+ *          std::lock_guard<thread_utils::ProfiledMutex> guard(table_mutex);
+ *          ...
+ *      }
+ *      thread_utils::LockProfiler::dump(stderr);
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+
+namespace thread_utils
+{
+#ifdef THREAD_UTILS_LOCK_PROFILING
+    class LockProfile final
+    {
+    public:
+        static const uint32_t HISTOGRAM_BUCKETS = 40;//bucket i counts durations in [2^i, 2^(i+1)) nanoseconds
+        static const uint32_t CALL_SITES = 8;//reported by dump() and topCallSites()
+        static const uint32_t TRACKED_CALL_SITES = 64;//counted, contention of further sites is counted as 'elsewhere'
+
+        struct CallSite
+        {
+            std::atomic<const void*>    address;
+            std::atomic<uint64_t>       count;
+        };
+
+        explicit LockProfile(const std::string& name);
+
+        const std::string& name() const { return mName; }
+        uint64_t acquisitions() const   { return mAcquisitions.load(std::memory_order_relaxed); }
+        uint64_t contended() const      { return mContended.load(std::memory_order_relaxed); }
+        uint64_t totalWaitNs() const    { return mWaitNs.load(std::memory_order_relaxed); }
+        /**
+         * Ratio of contended acquisitions in the range of 0.0 to 1.0
+         */
+        double contentionRatio() const;
+        /**
+         * Returns the most contended call sites (return address, contended acquisitions), most contended first.
+         * Every Nth contended acquisition of a lock records its call site weighted by N (see
+         * LockProfiler::setSampleRate()), so the counts are estimates unless the sample rate is 1.
+         */
+        std::vector<std::pair<const void*, uint64_t>> topCallSites() const;
+        /**
+         * Returns the upper bound of the given percentile (0.0 - 1.0) of wait time in nanoseconds
+         */
+        uint64_t waitPercentile(double percentile) const;
+        /**
+         * Returns the upper bound of the given percentile (0.0 - 1.0) of sampled hold time in nanoseconds
+         */
+        uint64_t holdPercentile(double percentile) const;
+        /**
+         * Prints the profile in a human readable form
+         */
+        void dump(FILE* out) const;
+        void reset();
+
+        void addAcquisitions(uint64_t count)    { mAcquisitions.fetch_add(count, std::memory_order_relaxed); }
+        /**
+         * @param call_site nullptr if the call site is not sampled
+         * @param weight Contended acquisitions the sampled call site stands for
+         */
+        void recordWait(uint64_t wait_ns, const void* call_site, uint32_t weight);
+        void recordHold(uint64_t hold_ns);
+    private:
+        const std::string       mName;
+        std::atomic<uint64_t>   mAcquisitions;
+        std::atomic<uint64_t>   mContended;
+        std::atomic<uint64_t>   mWaitNs;
+        std::atomic<uint64_t>   mHoldNs;
+        std::atomic<uint64_t>   mHoldSamples;
+        std::atomic<uint64_t>   mWaitHistogram[HISTOGRAM_BUCKETS];
+        std::atomic<uint64_t>   mHoldHistogram[HISTOGRAM_BUCKETS];
+        CallSite                mCallSites[TRACKED_CALL_SITES];//open addressing hash table by address
+    };
+
+    class LockProfiler final
+    {
+    public:
+        /**
+         * Returns the profile registered under the given name, it is created on first use and never destroyed
+         */
+        static LockProfile& profile(const std::string& name);
+        /**
+         * Hold time is measured for every Nth acquisition of a lock, the call site is recorded for every Nth
+         * contended acquisition. Default value: 64
+         * @param every_nth 1 measures every acquisition
+         */
+        static inline void setSampleRate(uint32_t every_nth)
+        { sampleRateStorage().store(every_nth > 0 ? every_nth : 1, std::memory_order_relaxed); }
+        static inline uint32_t sampleRate()
+        { return sampleRateStorage().load(std::memory_order_relaxed); }
+        /**
+         * Prints every registered profile ordered by total wait time
+         */
+        static void dump(FILE* out = stderr);
+        /**
+         * Clears the statistics of every registered profile
+         */
+        static void reset();
+    private:
+        static inline std::atomic<uint32_t>& sampleRateStorage()
+        {
+            static std::atomic<uint32_t> rate(64);
+            return rate;
+        }
+    };
+
+    namespace detail
+    {
+        /**
+         * Records the statistics of one lock. Every member except the constructor is called while the lock is held,
+         * so the local counters need no synchronization.
+         */
+        class LockProbe final
+        {
+        public:
+            explicit LockProbe(const char* name)
+                : mProfile(&LockProfiler::profile(name)), mAcquiredNs(0), mCount(0), mContendedCount(0) {}
+            ~LockProbe() { mProfile->addAcquisitions(mCount); }
+
+            static inline uint64_t now()
+            {
+                return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+            }
+
+            inline void contended(uint64_t wait_ns, const void* call_site)
+            {//the call site table is updated for every Nth contention only, like the hold time
+                const uint32_t rate = LockProfiler::sampleRate();
+                if( ++mContendedCount >= rate )
+                {
+                    mContendedCount = 0;
+                    mProfile->recordWait(wait_ns, call_site, rate);
+                } else {
+                    mProfile->recordWait(wait_ns, nullptr, 0);
+                }
+            }
+
+            inline void acquired()
+            {
+                if( ++mCount >= LockProfiler::sampleRate() )
+                {//acquisitions are published in batches to avoid a shared atomic increment per lock()
+                    mProfile->addAcquisitions(mCount);
+                    mCount = 0;
+                    mAcquiredNs = now();
+                }
+            }
+
+            inline void releasing()
+            {
+                if( mAcquiredNs )
+                {
+                    mProfile->recordHold(now() - mAcquiredNs);
+                    mAcquiredNs = 0;
+                }
+            }
+        private:
+            LockProfile*    mProfile;
+            uint64_t        mAcquiredNs;
+            uint32_t        mCount;
+            uint32_t        mContendedCount;
+        };
+    }
+
+    /**
+     * std::mutex recording its contention to the LockProfile of the given name. Implements 'Lockable' concept.
+     */
+    class ProfiledMutex final
+    {
+    public:
+        explicit ProfiledMutex(const char* name = "ProfiledMutex") : mMutex(), mProbe(name) {}
+        ProfiledMutex(const ProfiledMutex&) = delete;
+        ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+        __attribute__((noinline)) void lock()
+        {
+            if( !mMutex.try_lock() )
+            {
+                uint64_t begin = detail::LockProbe::now();
+                mMutex.lock();
+                mProbe.contended(detail::LockProbe::now() - begin, __builtin_return_address(0));
+            }
+            mProbe.acquired();
+        }
+
+        inline bool try_lock()
+        {
+            if( !mMutex.try_lock() ) { return false; }
+            mProbe.acquired();
+            return true;
+        }
+
+        inline void unlock()
+        {
+            mProbe.releasing();
+            mMutex.unlock();
+        }
+    private:
+        std::mutex          mMutex;
+        detail::LockProbe   mProbe;
+    };
+#else
+    /**
+     * Profiling is compiled out: a plain std::mutex. Implements 'Lockable' concept.
+     */
+    class ProfiledMutex final
+    {
+    public:
+        explicit ProfiledMutex(const char* = nullptr) : mMutex() {}
+        ProfiledMutex(const ProfiledMutex&) = delete;
+        ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+        inline void lock()      { mMutex.lock(); }
+        inline bool try_lock()  { return mMutex.try_lock(); }
+        inline void unlock()    { mMutex.unlock(); }
+    private:
+        std::mutex mMutex;
+    };
+
+    class LockProfiler final
+    {
+    public:
+        static inline void setSampleRate(uint32_t) {}
+        static inline uint32_t sampleRate() { return 0; }
+        static inline void dump(FILE* = stderr) {}
+        static inline void reset() {}
+    };
+#endif
+}
+
+#endif
@@ -13,39 +13,221 @@
 #include <atomic>
 #include <chrono>
 
+#include "async_waiter.h"
+#include "stop_token.h"
+#include "trace.h"
+
 namespace thread_utils
 {
     template<uint32_t LIMIT>
     class Semaphore
     {
     protected:
+        /**
+         * Node of a queued waiter, it lives on the stack of the waiting thread or in the frame of the suspended coroutine
+         */
+        struct Waiter
+        {
+            Waiter*                     next;
+            Waiter*                     prev;
+            uint32_t                    units;
+            bool                        granted;    //the units were taken for the waiter by post()
+            std::condition_variable*    condition;  //nullptr for a coroutine
+            detail::AsyncWaiter*        async;      //nullptr for a thread
+
+            Waiter(uint32_t units_count, std::condition_variable* condition_variable, detail::AsyncWaiter* async_waiter)
+                : next(nullptr), prev(nullptr), units(units_count), granted(false), condition(condition_variable), async(async_waiter) {}
+        };
+
         mutable std::mutex      mMutex;
-        std::condition_variable mConditionVariable;
         std::atomic<uint32_t>   mCounter;
         std::atomic<uint32_t>   mLimit;        
+        bool                    mFair;
+        Waiter*                 mHead;
+        Waiter*                 mTail;
+
+        static void stop_notify(void* arg)
+        {
+            Semaphore* self = static_cast<Semaphore*>(arg);
+            //a waiter checking the token under the lock has either seen the request or is already waiting
+            std::lock_guard<std::mutex> locker(self->mMutex);
+            for(Waiter* waiter = self->mHead; waiter; waiter = waiter->next)
+            {
+                if( waiter->condition ) { waiter->condition->notify_one(); }
+            }
+        }
+
+        inline void enqueue(Waiter* waiter)
+        {
+            waiter->next = nullptr;
+            waiter->prev = mTail;
+            if( mTail ) { mTail->next = waiter; }
+            else        { mHead = waiter; }
+            mTail = waiter;
+        }
+
+        inline void dequeue(Waiter* waiter)
+        {
+            if( waiter->prev ) { waiter->prev->next = waiter->next; }
+            else               { mHead = waiter->next; }
+            if( waiter->next ) { waiter->next->prev = waiter->prev; }
+            else               { mTail = waiter->prev; }
+        }
+        /**
+         * Takes the units of queued waiters from the counter in queue order and wakes only those waiters.
+         * In FIFO-fair mode it stops at the first waiter that can not be satisfied, otherwise it skips it.
+         * Threads and coroutines share the queue. Called with mMutex held.
+         * @return The granted coroutines linked by their next pointer, to be resumed after unlocking (see resume())
+         */
+        detail::AsyncWaiter* grant()
+        {
+            detail::AsyncWaiter* resumed = nullptr;
+            detail::AsyncWaiter** tail = &resumed;
+            Waiter* waiter = mHead;
+            while( waiter && (mCounter.load() > 0) )
+            {
+                Waiter* next = waiter->next;
+                if( waiter->units <= mCounter.load() )
+                {
+                    mCounter -= waiter->units;
+                    dequeue(waiter);
+                    waiter->granted = true;
+                    if( waiter->condition )
+                    { //notified under the lock, the node is destroyed as soon as its thread may return
+                        waiter->condition->notify_one();
+                    } else {
+                        *tail = waiter->async;
+                        tail = &waiter->async->next;
+                        *tail = nullptr;
+                    }
+                } else if( mFair ) {
+                    break;
+                }
+                waiter = next;
+            }
+            return resumed;
+        }
+
+        static void resume(detail::AsyncWaiter* waiters)
+        {
+            while( waiters )
+            {
+                detail::AsyncWaiter* waiter = waiters;
+                waiters = waiter->next;
+                waiter->wake(waiter);
+            }
+        }
+
+        inline bool can_barge(uint32_t units) const { return (!mFair || !mHead) && (mCounter.load() >= units); }
+        /**
+         * Common implementation of every blocking wait. Decrements the counter by @p units at once or not at all.
+         * A waiter that can not take its units at once is queued and sleeps until post() grants them.
+         * @param units Number of units to take
+         * @param deadline nullptr waits without timeout
+         * @param token nullptr waits without stop token (the caller registers the stop notification)
+         * @return True is returned if the units were taken
+         */
+        bool acquire(uint32_t units, const std::chrono::steady_clock::time_point* deadline, const StopToken* token)
+        {
+            std::unique_lock<std::mutex> locker(mMutex);
+            if( can_barge(units) )
+            {
+                mCounter -= units;
+                return true;
+            }
+
+            std::condition_variable condition;
+            Waiter self(units, &condition, nullptr);
+            enqueue(&self);
+            auto ready = [&] { return self.granted || (token && token->stop_requested()); };
+
+            THREAD_UTILS_TRACE_BEGIN("Semaphore::wait");
+            if( deadline )  { condition.wait_until(locker, *deadline, ready); }
+            else            { condition.wait(locker, ready); }
+            THREAD_UTILS_TRACE_END("Semaphore::wait");
+
+            if( self.granted ) { return true; }
+            dequeue(&self);
+            //in FIFO-fair mode the waiters behind a leaving head might be satisfied by the available units
+            detail::AsyncWaiter* resumed = grant();
+            locker.unlock();
+            resume(resumed);
+            return false;
+        }
+
+        bool acquire_for(uint32_t units, int64_t timeout_ms, const StopToken* token)
+        {
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            return acquire(units, &deadline, token);
+        }
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        /**
+         * Decrements the counter if possible, otherwise queues the given waiter to be granted a unit by post()
+         * @return True is returned if the counter was decremented
+         */
+        bool acquire_or_enqueue(Waiter* waiter)
+        {
+            std::lock_guard<std::mutex> locker(mMutex);
+            if( can_barge(1) )
+            {
+                --mCounter;
+                return true;
+            }
+            enqueue(waiter);
+            return false;
+        }
+#endif
     public:
-        Semaphore() : mMutex(), mConditionVariable(), mCounter(0), mLimit(LIMIT) {}
+        Semaphore() : mMutex(), mCounter(0), mLimit(LIMIT), mFair(false), mHead(nullptr), mTail(nullptr) {}
         ~Semaphore()
         {
-            {   
-                std::lock_guard<std::mutex> locker(mMutex);
-                mCounter.store(0);
-            }
-            mConditionVariable.notify_all();
+            std::lock_guard<std::mutex> locker(mMutex);
+            mCounter.store(0);
+        }
+        /**
+         * Enables FIFO-fair mode: waiting threads and coroutines take their units in arrival order, so a large wait(n) is
+         * not starved by a stream of small requests. Otherwise post() hands units to every queued waiter it can satisfy,
+         * skipping larger requests. Set it before the semaphore is used. Default: disabled
+         * @param fair
+         */
+        void set_fair(bool fair)
+        {
+            std::lock_guard<std::mutex> locker(mMutex);
+            mFair = fair;
+        }
+        /**
+         * Returns true if FIFO-fair mode is enabled
+         */
+        bool is_fair() const
+        {
+            std::lock_guard<std::mutex> locker(mMutex);
+            return mFair;
         }
         /**
          * Increment the semaphore counter by one if it is below the limit
          * @return If the semaphore counter would exceed the limit then false is returned, otherwise true
          */
-        bool post()
+        inline bool post() { return post(1); }
+        /**
+         * Increment the semaphore counter by the given units at once. Only the queued waiters the units are handed to
+         * are woken, in FIFO-fair mode in arrival order.
+         * @param units
+         * @return If the semaphore counter would exceed the limit then false is returned and the counter is left unchanged, otherwise true
+         */
+        bool post(uint32_t units)
         {
+            if( units == 0 ) { return true; }
             if( mCounter.load() < mLimit ) // mCounter is atomic to avoid switching to kernel space if the LIMIT has reached
             { 
-                { //locking only while incrementing mCounter to avoid waking the waiting thread only to block again 
+                detail::AsyncWaiter* resumed = nullptr;
+                {
                     std::lock_guard<std::mutex> locker(mMutex);
-                    ++mCounter;
+                    if( static_cast<uint64_t>(mCounter.load()) + units > mLimit.load() ) { return false; }
+                    mCounter += units;
+                    if( mHead ) { resumed = grant(); }
                 }
-                mConditionVariable.notify_all();
+                //suspended coroutines are resumed on their executors, outside of the lock
+                resume(resumed);
                 return true;
             } else {
                 return false;
@@ -64,38 +246,133 @@ namespace thread_utils
          */
         inline uint32_t value() const { return mCounter.load(); }
         /**
-         * Block the current thread until the semaphore counter rises above 0
+         * Decrement the semaphore counter by the given units without blocking
+         * @param units Default value: 1
+         * @return False is returned if the counter was less than @p units (it is left unchanged then)
          */
-        void wait()
+        bool try_wait(uint32_t units = 1)
         {
-            std::unique_lock<std::mutex> locker(mMutex);
-            if( mCounter.load() > 0 )
+            if( mCounter.load() < units ) { return false; }
+            std::lock_guard<std::mutex> locker(mMutex);
+            if( can_barge(units) )
             {
-                --mCounter;
-            } else {
-                mConditionVariable.wait(locker, [&]{ return (mCounter.load() > 0); });
-                if( mCounter.load() > 0) { --mCounter; }
+                mCounter -= units;
+                return true;
             }
+            return false;
         }
+        /**
+         * Block the current thread until the semaphore counter rises above 0
+         */
+        inline void wait() { acquire(1, nullptr, nullptr); }
         /**
          * Block the current thread until the semaphore counter rises above 0 or after the specified timeout duration
          * @param timeout_ms - timeout in milliseconds
          * @return False is returned if the given time has run out.
          */
-        bool wait_for(int64_t timeout_ms)
+        inline bool wait_for(int64_t timeout_ms) { return acquire_for(1, timeout_ms, nullptr); }
+        /**
+         * Block the current thread until the given units can be taken at once
+         * @param units
+         */
+        inline void wait(uint32_t units) { acquire(units, nullptr, nullptr); }
+        /**
+         * Block the current thread until the given units can be taken at once or after the specified timeout duration.
+         * Nothing is taken on timeout.
+         * @param units
+         * @param timeout_ms - timeout in milliseconds
+         * @return False is returned if the given time has run out.
+         */
+        inline bool wait_for(uint32_t units, int64_t timeout_ms) { return acquire_for(units, timeout_ms, nullptr); }
+        /**
+         * Block the current thread until the semaphore counter rises above 0 or stop is requested on the given token
+         * @param token
+         * @return False is returned if stop was requested before the counter could be decremented.
+         */
+        bool wait(const StopToken& token)
         {
-            std::unique_lock<std::mutex> locker(mMutex);
-            if( mCounter.load() > 0 )
+            detail::StopNotifier notifier(token, &Semaphore::stop_notify, this);
+            return acquire(1, nullptr, &token);
+        }
+        /**
+         * Block the current thread until the semaphore counter rises above 0, stop is requested on the given token
+         * or after the specified timeout duration
+         * @param timeout_ms - timeout in milliseconds
+         * @param token
+         * @return False is returned if the given time has run out or stop was requested.
+         */
+        bool wait_for(int64_t timeout_ms, const StopToken& token)
+        {
+            detail::StopNotifier notifier(token, &Semaphore::stop_notify, this);
+            return acquire_for(1, timeout_ms, &token);
+        }
+        /**
+         * Block the current thread until the semaphore counter rises above 0 or the given steady clock time is reached.
+         * The deadline is absolute, so waking up early and waiting again does not accumulate drift.
+         * @param deadline
+         * @return False is returned if the deadline has passed.
+         */
+        inline bool wait_until(const std::chrono::steady_clock::time_point& deadline) { return acquire(1, &deadline, nullptr); }
+        /**
+         * Block the current thread until the given units can be taken at once or the given steady clock time is reached.
+         * @param units
+         * @param deadline
+         * @return False is returned if the deadline has passed, nothing is taken then.
+         */
+        inline bool wait_until(uint32_t units, const std::chrono::steady_clock::time_point& deadline) { return acquire(units, &deadline, nullptr); }
+        /**
+         * Same as wait_for(timeout_ms) with a std::chrono duration of any precision
+         */
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        /**
+         * Same as wait_for(units, timeout_ms) with a std::chrono duration of any precision
+         */
+        template<typename Rep, typename Period>
+        inline bool wait_for(uint32_t units, const std::chrono::duration<Rep, Period>& timeout)
+        { return wait_until(units, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        /**
+         * Same as wait_until(deadline) but returns false if stop is requested on the given token
+         */
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline, const StopToken& token)
+        {
+            detail::StopNotifier notifier(token, &Semaphore::stop_notify, this);
+            return acquire(1, &deadline, &token);
+        }
+        /**
+         * Same as wait_for(timeout) but returns false if stop is requested on the given token
+         */
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout, const StopToken& token)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout), token); }
+#ifdef THREAD_UTILS_HAS_COROUTINES
+        /**
+         * Awaitable returned by async_acquire()
+         */
+        class AcquireAwaiter
+        {
+        private:
+            Semaphore&              mSemaphore;
+            detail::CoroutineWaiter mWaiter;
+            Waiter                  mNode;
+        public:
+            explicit AcquireAwaiter(Semaphore& semaphore) : mSemaphore(semaphore), mWaiter(), mNode(1, nullptr, &mWaiter) {}
+            bool await_ready() { return mSemaphore.try_wait(); }
+            bool await_suspend(std::coroutine_handle<> handle)
             {
-                --mCounter;
-                return true;
-            } else {
-                std::chrono::milliseconds dur{timeout_ms};
-                bool waken = mConditionVariable.wait_for(locker, dur, [&]{ return (mCounter.load() > 0); });
-                if( waken && ( mCounter.load() > 0) ) { --mCounter; }
-                return waken;
+                mWaiter.suspend(handle);
+                return !mSemaphore.acquire_or_enqueue(&mNode);
             }
-        }
+            void await_resume() {}
+        };
+        /**
+         * Suspend the calling coroutine until the semaphore counter can be decremented.
+         * Usage: co_await semaphore.async_acquire();
+         * The coroutine is queued with the waiting threads and resumed by post() directly (on its executor).
+         */
+        AcquireAwaiter async_acquire() { return AcquireAwaiter(*this); }
+#endif
 
     };
 
@@ -0,0 +1,235 @@
+#ifndef _SHARDED_QUEUE_H_
+#define _SHARDED_QUEUE_H_
+
+/**
+ * C++17 required for compilation
+ * Multi-producer multi-consumer queue split into shards to spread the contention of many producers.
+ * Producers push into the shard of their CPU (or of their thread), consumers drain their own shard first
+ * and steal from the others when it is empty. Producers share no written state: a push touches only its shard and reads
+ * the sleeper count, it wakes exactly one consumer and only if a consumer sleeps. Idle consumers sleep on a futex.
+ * Ordering is FIFO per shard only.
+ *
+ * Example:
+ *
+ *      thread_utils::ShardedBlockingQueue<Packet> ingest;//one shard per CPU
+ *      ...producers:
+ *      ingest.push(packet);
+ *      ...consumers:
+ *      if( auto packet = ingest.pop(100) ) { handle(*packet); }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sched.h>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include <chrono>
+
+#include "futex.h"
+#include "stop_token.h"
+#include "profiled_mutex.h"
+
+namespace thread_utils
+{
+    /**
+     * Selects the shard of the calling thread
+     */
+    enum class ShardSelection
+    {
+        Cpu,    //by the CPU the caller runs on (sched_getcpu)
+        Thread  //by an index assigned to the calling thread on first use
+    };
+
+    template<typename T>
+    class ShardedBlockingQueue
+    {
+    private:
+        struct alignas(64) Shard
+        {
+            ProfiledMutex           mutex;
+            std::deque<T>           queue;
+            std::atomic<size_t>     size;
+            Shard() : mutex("ShardedBlockingQueue"), queue(), size(0) {}
+        };
+
+        const size_t                mShardCount;
+        const ShardSelection        mSelection;
+        std::unique_ptr<Shard[]>    mShards;
+        alignas(64) std::atomic<uint32_t> mSleepers;//consumers about to sleep or sleeping
+        alignas(64) std::atomic<uint32_t> mEpoch;   //futex word, changed by every wakeup
+
+        size_t affineShard() const
+        {
+            if( mSelection == ShardSelection::Cpu )
+            {
+                int cpu = sched_getcpu();
+                if( cpu >= 0 ) { return static_cast<size_t>(cpu) % mShardCount; }
+            }
+            static std::atomic<size_t> next_thread_index(0);
+            static thread_local size_t thread_index = next_thread_index.fetch_add(1);
+            return thread_index % mShardCount;
+        }
+
+        template<typename U>
+        void insert(U&& element)
+        {
+            Shard& shard = mShards[affineShard()];
+            {
+                std::lock_guard<ProfiledMutex> guard(shard.mutex);
+                shard.queue.push_back(std::forward<U>(element));
+                shard.size.fetch_add(1, std::memory_order_relaxed);
+            }
+            //pairs with the fence of a consumer going to sleep: either it sees the element or this sees the sleeper
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if( mSleepers.load(std::memory_order_relaxed) > 0 ) { wakeOne(); }
+        }
+
+        void wakeOne()
+        {
+            mEpoch.fetch_add(1, std::memory_order_release);
+            detail::futexWakeOne(mEpoch);
+        }
+
+        static void stopNotify(void* arg)
+        {
+            ShardedBlockingQueue* self = static_cast<ShardedBlockingQueue*>(arg);
+            self->mEpoch.fetch_add(1, std::memory_order_release);
+            detail::futexWakeAll(self->mEpoch);
+        }
+        /**
+         * Removes an element, starting with the affine shard
+         */
+        std::optional<T> take()
+        {
+            const size_t first = affineShard();
+            for(size_t i = 0; i < mShardCount; ++i)
+            {
+                Shard& shard = mShards[(first + i) % mShardCount];
+                if( shard.size.load(std::memory_order_relaxed) == 0 ) { continue; }
+                std::lock_guard<ProfiledMutex> guard(shard.mutex);
+                if( !shard.queue.empty() )
+                {
+                    std::optional<T> element(std::move(shard.queue.front()));
+                    shard.queue.pop_front();
+                    shard.size.fetch_sub(1, std::memory_order_relaxed);
+                    return element;
+                }
+            }
+            return std::nullopt;
+        }
+        /**
+         * Takes an element, sleeping on the futex while every shard is empty
+         * @param deadline Optional
+         * @param token Optional
+         */
+        std::optional<T> waitTake(const std::chrono::steady_clock::time_point* deadline, const StopToken* token)
+        {
+            while( true )
+            {
+                std::optional<T> element = take();
+                if( element ) { return element; }
+                if( token && token->stop_requested() ) { return std::nullopt; }
+
+                const uint32_t epoch = mEpoch.load(std::memory_order_acquire);
+                mSleepers.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                element = take();
+                if( element )
+                {
+                    mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                    return element;
+                }
+                bool expired = false;
+                if( !token || !token->stop_requested() )
+                {
+                    if( !deadline )                                               { detail::futexWait(mEpoch, epoch); }
+                    else if( !detail::futexWaitUntil(mEpoch, epoch, *deadline) ) { expired = true; }
+                }
+                mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                if( expired || (token && token->stop_requested()) )
+                {
+                    element = take();
+                    //the wakeup of a pushed element may have been consumed by this leaving consumer, pass it on
+                    if( !element && (size() > 0) && (mSleepers.load(std::memory_order_relaxed) > 0) ) { wakeOne(); }
+                    return element;
+                }
+            }
+        }
+    public:
+        /**
+         * @param shard_count Number of shards, 0 selects the number of hardware threads
+         * @param selection Producers and consumers prefer the shard of their CPU or of their thread
+         */
+        explicit ShardedBlockingQueue(size_t shard_count = 0, ShardSelection selection = ShardSelection::Cpu)
+            : mShardCount(shard_count ? shard_count : std::max<size_t>(1, std::thread::hardware_concurrency()))
+            , mSelection(selection)
+            , mShards(new Shard[mShardCount])
+            , mSleepers(0)
+            , mEpoch(0)
+        {}
+        /**
+         * Push an element into the shard of the calling thread
+         * Copies the given value!
+         */
+        void push(const T& element) { insert(element); }
+        /**
+         * Push an element into the shard of the calling thread
+         * Moves the given value!
+         */
+        void push(T&& element) { insert(std::move(element)); }
+        /**
+         * Pops the first element of the affine shard or of another shard if it is empty.
+         * This function is blocking while there is no element in the queue.
+         * @param timeout_ms The maximum amount of milliseconds to wait while the queue is empty. If the value is equal or
+         * lesser than 0 it will wait forever. Default value: -1
+         * @return If the given time has passed an std::nullopt is returned, otherwise a value of type T is returned.
+         */
+        std::optional<T> pop(int64_t timeout_ms = -1)
+        {
+            if( timeout_ms > 0 )
+            {
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+                return waitTake(&deadline, nullptr);
+            }
+            return waitTake(nullptr, nullptr);
+        }
+        /**
+         * Same as pop(timeout_ms) but returns std::nullopt if stop is requested on the given token
+         */
+        std::optional<T> pop(const StopToken& token, int64_t timeout_ms = -1)
+        {
+            detail::StopNotifier notifier(token, &ShardedBlockingQueue::stopNotify, this);
+            if( timeout_ms > 0 )
+            {
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+                return waitTake(&deadline, &token);
+            }
+            return waitTake(nullptr, &token);
+        }
+        /**
+         * Pops an element without blocking
+         * @return std::nullopt is returned if the queue is empty
+         */
+        std::optional<T> try_pop() { return take(); }
+        /**
+         * Returns the number of elements (a snapshot, the queue may change concurrently)
+         */
+        size_t size() const
+        {
+            size_t total = 0;
+            for(size_t i = 0; i < mShardCount; ++i) { total += mShards[i].size.load(std::memory_order_relaxed); }
+            return total;
+        }
+        /**
+         * Returns the number of shards
+         */
+        size_t shards() const { return mShardCount; }
+    };
+}
+
+#endif
@@ -0,0 +1,389 @@
+#ifndef _SHARED_MUTEX_H_
+#define _SHARED_MUTEX_H_
+
+/**
+ * C++11 required for compilation, Linux only (futex)
+ * Header only futex based locks next to ConditionMutex, with the same wait() / notify_*() interface:
+ *
+ * AdaptiveMutex - three state futex mutex (unlocked, locked, locked with sleepers). An uncontended lock and unlock are one
+ * atomic operation each, a contended lock spins for a bounded number of rounds adapted to the recent hold times before
+ * sleeping, and unlock enters the kernel only if somebody sleeps.
+ *
+ * ShardedSharedMutex - reader-writer lock for read-mostly data. Every reader increments a counter in the cache line of
+ * its shard (picked by an index assigned to the calling thread), so readers on different shards never write a shared
+ * line. A writer raises a flag and waits for every shard to drain. The reader increments its counter then loads the flag,
+ * the writer stores the flag then loads the counters, both sequentially consistent, so either the reader sees the flag
+ * and backs off or the writer sees the reader. Pending writers take precedence over new readers.
+ *
+ * Example:
+ *
+ *      thread_utils::ShardedSharedMutex routes_mutex;
+ *      ...many readers:
+ *      {
+ *          std::shared_lock<thread_utils::ShardedSharedMutex> guard(routes_mutex);
+ *          next_hop = routes.lookup(address);
+ *      }
+ *      ...rare writer:
+ *      {
+ *          std::lock_guard<thread_utils::ShardedSharedMutex> guard(routes_mutex);
+ *          routes.update(prefix, gateway);
+ *      }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "futex.h"
+#include "stop_token.h"
+
+namespace thread_utils
+{
+    namespace detail
+    {
+        /**
+         * Condition variable on a futex sequence word, used with any Lockable held by the waiter.
+         * Waiters return when the sequence changed, a stop request wakes every waiter of the condition,
+         * so waiters re-check their condition.
+         */
+        class FutexCondition final
+        {
+        public:
+            FutexCondition() : mSequence(0), mWaiters(0) {}
+            FutexCondition(const FutexCondition&) = delete;
+            FutexCondition& operator=(const FutexCondition&) = delete;
+            /**
+             * Unlocks @p lockable, waits and locks it again
+             * @param deadline Optional, nullptr waits without timeout
+             * @param token Optional
+             * @return False is returned if the deadline was reached or stop was requested before a notification
+             */
+            template<typename Lockable>
+            bool wait(Lockable& lockable, const std::chrono::steady_clock::time_point* deadline, const StopToken* token)
+            {
+                mWaiters.fetch_add(1);
+                const uint32_t sequence = mSequence.load();
+                lockable.unlock();
+                bool waken = false;
+                if( token && token->stop_possible() )
+                {
+                    StopNotifier notifier(*token, &FutexCondition::stopNotify, this);
+                    waken = sleep(sequence, deadline, token);
+                } else {
+                    waken = sleep(sequence, deadline, nullptr);
+                }
+                mWaiters.fetch_sub(1);
+                lockable.lock();
+                return waken;
+            }
+
+            inline void notify_one()
+            {
+                mSequence.fetch_add(1);
+                if( mWaiters.load() > 0 ) { futexWakeOne(mSequence); }
+            }
+
+            inline void notify_all()
+            {
+                mSequence.fetch_add(1);
+                if( mWaiters.load() > 0 ) { futexWakeAll(mSequence); }
+            }
+        private:
+            bool sleep(uint32_t sequence, const std::chrono::steady_clock::time_point* deadline, const StopToken* token)
+            {
+                while( mSequence.load(std::memory_order_acquire) == sequence )
+                {
+                    if( token && token->stop_requested() ) { return false; }
+                    if( !deadline )
+                    {
+                        futexWait(mSequence, sequence);
+                    } else if( !futexWaitUntil(mSequence, sequence, *deadline) ) {
+                        return false;
+                    }
+                }
+                return !(token && token->stop_requested());
+            }
+
+            static void stopNotify(void* arg)
+            { //the sequence changes, so a waiter between its token check and the futex call does not sleep
+                static_cast<FutexCondition*>(arg)->notify_all();
+            }
+
+            std::atomic<uint32_t>   mSequence;
+            std::atomic<uint32_t>   mWaiters;
+        };
+
+        /**
+         * Index assigned to the calling thread on first use
+         */
+        inline size_t threadShardIndex()
+        {
+            static std::atomic<size_t> next_thread_index(0);
+            static thread_local size_t thread_index = next_thread_index.fetch_add(1);
+            return thread_index;
+        }
+    }
+
+    class AdaptiveMutex final
+    {
+    public:
+        /**
+         * @param max_spin Upper bound of the spin rounds of a contended lock before sleeping
+         */
+        explicit AdaptiveMutex(uint32_t max_spin = 1000) : mState(UNLOCKED), mSpinEstimate(0), mMaxSpin(max_spin), mCondition() {}
+        AdaptiveMutex(const AdaptiveMutex&) = delete;
+        AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+        inline void lock()
+        {
+            uint32_t expected = UNLOCKED;
+            if( !mState.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed) )
+            { lockContended(); }
+        }
+
+        inline bool try_lock()
+        {
+            uint32_t expected = UNLOCKED;
+            return mState.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        inline void unlock()
+        {
+            if( mState.exchange(UNLOCKED, std::memory_order_release) == SLEEPERS ) { detail::futexWakeOne(mState); }
+        }
+        /**
+         * Block the current thread until notified. The mutex must be locked by the caller.
+         */
+        void wait() { mCondition.wait(*this, nullptr, nullptr); }
+        /**
+         * @return False is returned if it is not waken up before the given timeout expired.
+         */
+        bool wait_for(int64_t timeout_ms) { return wait_for(std::chrono::milliseconds(timeout_ms)); }
+        /**
+         * @return False is returned if stop was requested before the mutex was notified.
+         */
+        bool wait(const StopToken& token) { return mCondition.wait(*this, nullptr, &token); }
+        bool wait_for(int64_t timeout_ms, const StopToken& token) { return wait_for(std::chrono::milliseconds(timeout_ms), token); }
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline) { return mCondition.wait(*this, &deadline, nullptr); }
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline, const StopToken& token)
+        { return mCondition.wait(*this, &deadline, &token); }
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout, const StopToken& token)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout), token); }
+
+        void notify_one() { mCondition.notify_one(); }
+        void notify_all() { mCondition.notify_all(); }
+    private:
+        static const uint32_t UNLOCKED = 0;
+        static const uint32_t LOCKED = 1;
+        static const uint32_t SLEEPERS = 2;
+
+        void lockContended()
+        {
+            //spin up to twice the recent average, the average follows the spins needed (like glibc's adaptive mutex)
+            const uint32_t estimate = mSpinEstimate.load(std::memory_order_relaxed);
+            const uint32_t limit = (estimate * 2 + 10 < mMaxSpin) ? (estimate * 2 + 10) : mMaxSpin;
+            for(uint32_t spins = 0; spins < limit; ++spins)
+            {
+                uint32_t expected = UNLOCKED;
+                if( (mState.load(std::memory_order_relaxed) == UNLOCKED) &&
+                    mState.compare_exchange_weak(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed) )
+                {
+                    adapt(spins);
+                    return;
+                }
+                detail::cpuRelax();
+            }
+            adapt(limit);
+            //the state stays SLEEPERS while anybody may sleep, so every unlock wakes the next one
+            while( mState.exchange(SLEEPERS, std::memory_order_acquire) != UNLOCKED )
+            {
+                detail::futexWait(mState, SLEEPERS);
+            }
+        }
+
+        inline void adapt(uint32_t spins)
+        {
+            const int32_t estimate = static_cast<int32_t>(mSpinEstimate.load(std::memory_order_relaxed));
+            mSpinEstimate.store(static_cast<uint32_t>(estimate + (static_cast<int32_t>(spins) - estimate) / 8), std::memory_order_relaxed);
+        }
+
+        std::atomic<uint32_t>   mState;
+        std::atomic<uint32_t>   mSpinEstimate;
+        const uint32_t          mMaxSpin;
+        detail::FutexCondition  mCondition;
+    };
+
+    class ShardedSharedMutex final
+    {
+    public:
+        /**
+         * @param shard_count Default value: std::thread::hardware_concurrency()
+         */
+        explicit ShardedSharedMutex(size_t shard_count = 0)
+            : mShardCount(shard_count ? shard_count : (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1))
+            , mShards(new Shard[mShardCount])
+            , mWriter(NO_WRITER)
+            , mWriterMutex()
+            , mCondition()
+        {}
+        ShardedSharedMutex(const ShardedSharedMutex&) = delete;
+        ShardedSharedMutex& operator=(const ShardedSharedMutex&) = delete;
+        /**
+         * Exclusive lock: waits for the other writers, then for the readers of every shard
+         */
+        void lock()
+        {
+            mWriterMutex.lock();
+            mWriter.store(WRITER);
+            for(size_t i = 0; i < mShardCount; ++i) { drain(mShards[i]); }
+        }
+
+        bool try_lock()
+        {
+            if( !mWriterMutex.try_lock() ) { return false; }
+            mWriter.store(WRITER);
+            for(size_t i = 0; i < mShardCount; ++i)
+            {
+                if( mShards[i].readers.load() != 0 )
+                {
+                    unlock();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void unlock()
+        {
+            if( mWriter.exchange(NO_WRITER) == WRITER_SLEEPERS ) { detail::futexWakeAll(mWriter); }
+            mWriterMutex.unlock();
+        }
+
+        inline void lock_shared()
+        {
+            Shard& shard = mShards[detail::threadShardIndex() % mShardCount];
+            while( true )
+            {
+                shard.readers.fetch_add(1);
+                if( mWriter.load() == NO_WRITER ) { return; }
+                release(shard);
+                waitForWriter();
+            }
+        }
+
+        inline bool try_lock_shared()
+        {
+            Shard& shard = mShards[detail::threadShardIndex() % mShardCount];
+            shard.readers.fetch_add(1);
+            if( mWriter.load() == NO_WRITER ) { return true; }
+            release(shard);
+            return false;
+        }
+
+        inline void unlock_shared()
+        {
+            release(mShards[detail::threadShardIndex() % mShardCount]);
+        }
+        /**
+         * Block the current thread until notified. The mutex must be locked exclusively by the caller.
+         */
+        void wait() { mCondition.wait(*this, nullptr, nullptr); }
+        /**
+         * @return False is returned if it is not waken up before the given timeout expired.
+         */
+        bool wait_for(int64_t timeout_ms) { return wait_for(std::chrono::milliseconds(timeout_ms)); }
+        /**
+         * @return False is returned if stop was requested before the mutex was notified.
+         */
+        bool wait(const StopToken& token) { return mCondition.wait(*this, nullptr, &token); }
+        bool wait_for(int64_t timeout_ms, const StopToken& token) { return wait_for(std::chrono::milliseconds(timeout_ms), token); }
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline) { return mCondition.wait(*this, &deadline, nullptr); }
+        bool wait_until(const std::chrono::steady_clock::time_point& deadline, const StopToken& token)
+        { return mCondition.wait(*this, &deadline, &token); }
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)); }
+        template<typename Rep, typename Period>
+        inline bool wait_for(const std::chrono::duration<Rep, Period>& timeout, const StopToken& token)
+        { return wait_until(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout), token); }
+
+        void notify_one() { mCondition.notify_one(); }
+        void notify_all() { mCondition.notify_all(); }
+    private:
+        static const uint32_t NO_WRITER = 0;
+        static const uint32_t WRITER = 1;
+        static const uint32_t WRITER_SLEEPERS = 2;//readers sleep until the writer unlocks
+
+        /**
+         * Reader counter in a cache line of its own
+         */
+        struct alignas(64) Shard
+        {
+            std::atomic<uint32_t> readers;
+            Shard() : readers(0) {}
+            //new[] is not over-aligned before C++17
+            static void* operator new[](size_t size)
+            {
+                void* pointer = nullptr;
+                if( posix_memalign(&pointer, 64, size) != 0 ) { throw std::bad_alloc(); }
+                return pointer;
+            }
+            static void operator delete[](void* pointer) { free(pointer); }
+        };
+
+        inline void release(Shard& shard)
+        {
+            //a writer sleeps on the counter of a shard only while its flag is raised
+            if( (shard.readers.fetch_sub(1) == 1) && (mWriter.load() != NO_WRITER) ) { detail::futexWakeOne(shard.readers); }
+        }
+
+        void drain(Shard& shard)
+        {
+            for(uint32_t i = 0; i < 128; ++i)
+            {
+                if( shard.readers.load() == 0 ) { return; }
+                detail::cpuRelax();
+            }
+            uint32_t readers = 0;
+            while( (readers = shard.readers.load()) != 0 )
+            {
+                detail::futexWait(shard.readers, readers);
+            }
+        }
+
+        void waitForWriter()
+        {
+            for(uint32_t i = 0; i < 128; ++i)
+            {
+                if( mWriter.load(std::memory_order_relaxed) == NO_WRITER ) { return; }
+                detail::cpuRelax();
+            }
+            uint32_t writer = mWriter.load();
+            while( writer != NO_WRITER )
+            {
+                if( (writer == WRITER_SLEEPERS) || mWriter.compare_exchange_weak(writer, WRITER_SLEEPERS) )
+                {
+                    detail::futexWait(mWriter, WRITER_SLEEPERS);
+                    writer = mWriter.load();
+                }
+            }
+        }
+
+        const size_t                mShardCount;
+        std::unique_ptr<Shard[]>    mShards;
+        alignas(64) std::atomic<uint32_t> mWriter;
+        AdaptiveMutex               mWriterMutex;
+        detail::FutexCondition      mCondition;
+    };
+}
+
+#endif
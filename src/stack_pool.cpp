@@ -0,0 +1,87 @@
+#include "stack_pool.h"
+#include <unistd.h>
+#include <sys/mman.h>
+
+static inline size_t roundToPages(size_t size)
+{
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+namespace thread_utils
+{
+
+StackPool::StackPool(size_t stack_size, size_t guard_size, bool huge_pages, bool prefault)
+    : mStackSize(roundToPages(stack_size))
+    , mGuardSize(roundToPages(guard_size))
+    , mHugePages(huge_pages)
+    , mPrefault(prefault)
+    , mMutex()
+    , mFree()
+{}
+
+StackPool::~StackPool()
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    for(void* stack : mFree)
+    { munmap(static_cast<char*>(stack) - mGuardSize, mGuardSize + mStackSize); }
+}
+
+void StackPool::reserve(size_t count)
+{
+    while( true )
+    {
+        {
+            std::lock_guard<std::mutex> guard(mMutex);
+            if( mFree.size() >= count ) { return; }
+        }
+        void* stack = create();
+        if( !stack ) { return; }
+        std::lock_guard<std::mutex> guard(mMutex);
+        mFree.push_back(stack);
+    }
+}
+
+void* StackPool::allocate(size_t size)
+{
+    if( size > mStackSize ) { return nullptr; }
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if( !mFree.empty() )
+        {
+            void* stack = mFree.back();
+            mFree.pop_back();
+            return stack;
+        }
+    }
+    return create();
+}
+
+void StackPool::deallocate(void* stack, size_t)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    mFree.push_back(stack);
+}
+
+void* StackPool::create()
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE;
+    if( mPrefault && !mHugePages ) { flags |= MAP_POPULATE; }
+    void* memory = mmap(NULL, mGuardSize + mStackSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if( memory == MAP_FAILED ) { return nullptr; }
+
+    char* stack = static_cast<char*>(memory) + mGuardSize;
+    if( mGuardSize ) { mprotect(memory, mGuardSize, PROT_NONE); }
+#ifdef MADV_HUGEPAGE
+    if( mHugePages ) { madvise(stack, mStackSize, MADV_HUGEPAGE); }
+#endif
+    if( mPrefault && mHugePages )
+    { //populated after the advice, so the faults can be served by huge pages
+        const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        for(size_t offset = 0; offset < mStackSize; offset += page_size)
+        { static_cast<volatile char*>(stack)[offset] = 0; }
+    }
+    return stack;
+}
+
+}//thread_utils end
@@ -0,0 +1,84 @@
+#ifndef _STACK_POOL_H_
+#define _STACK_POOL_H_
+
+/**
+ * C++11 required for compilation, Linux only
+ * Stack memory of Threads, see StackOptions and Thread::setStack().
+ *
+ * Example:
+ *
+ *      thread_utils::StackPool pool(64 * 1024, 4096, false, true);//64 KiB prefaulted stacks with a guard page
+ *      pool.reserve(1000);
+ *      thread_utils::StackOptions options;
+ *      options.allocator = &pool;
+ *      for(auto& worker : workers) { worker.setStack(options); worker.run(...); }
+ */
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+namespace thread_utils
+{
+    /**
+     * Provider of thread stacks. The memory of a stack is handed back after the thread is joined.
+     */
+    class StackAllocator
+    {
+    public:
+        virtual ~StackAllocator() {}
+        /**
+         * Returns the lowest address of a stack of at least the given size (aligned to the page size), nullptr on failure
+         * @param size 0 requests the default size of the allocator
+         */
+        virtual void* allocate(size_t size) = 0;
+        virtual void deallocate(void* stack, size_t size) = 0;
+        /**
+         * Default size of the stacks
+         */
+        virtual size_t stackSize() const = 0;
+    };
+
+    /**
+     * Recycles mmap'ed stacks of one size. Every stack has its own PROT_NONE guard below it. Huge page backing and
+     * prefaulting are applied once when a stack is created, reused stacks stay resident.
+     * The pool must outlive the threads running on its stacks, the stack of a detached thread is handed back after it
+     * finished (see StackOptions::allocator).
+     */
+    class StackPool final : public StackAllocator
+    {
+    public:
+        /**
+         * @param stack_size Usable size of every stack, rounded up to the page size
+         * @param guard_size Size of the guard below every stack, rounded up to the page size. Default value: one page
+         * @param huge_pages Advises transparent huge pages for the stacks (MADV_HUGEPAGE)
+         * @param prefault Populates the stacks when they are created, so the threads take no first-touch page faults
+         */
+        explicit StackPool(size_t stack_size, size_t guard_size = 4096, bool huge_pages = false, bool prefault = false);
+        ~StackPool();
+        StackPool(const StackPool&) = delete;
+        StackPool& operator=(const StackPool&) = delete;
+        /**
+         * Creates stacks until the given number of free stacks is available
+         */
+        void reserve(size_t count);
+        /**
+         * Returns a free stack or creates a new one, nullptr is returned if @p size exceeds the size of the pool
+         * or the memory can not be mapped
+         */
+        void* allocate(size_t size) override;
+        void deallocate(void* stack, size_t size) override;
+        size_t stackSize() const override { return mStackSize; }
+    private:
+        void* create();
+
+        const size_t        mStackSize;
+        const size_t        mGuardSize;
+        const bool          mHugePages;
+        const bool          mPrefault;
+        std::mutex          mMutex;
+        std::vector<void*>  mFree;
+    };
+}
+
+#endif
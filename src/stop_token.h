@@ -0,0 +1,224 @@
+#ifndef _STOP_TOKEN_H_
+#define _STOP_TOKEN_H_
+
+/**
+ * C++11 required for compilation
+ * Header only cooperative cancellation: a StopSource requests stop, StopTokens observe it.
+ * Blocking calls of this library accepting a StopToken return promptly when stop is requested,
+ * so indefinite waits need neither polling nor Thread::cancel() / Thread::kill().
+ *
+ * Example:
+ *
+ *      thread_utils::LoopThread consumer("consumer");
+ *      consumer.start([&data_queue](const thread_utils::StopToken& token)
+ *      {
+ *          if( auto data = data_queue.pop(token) ) //no timeout, returns std::nullopt on stop
+ *          { printf("New data: %lu\n", data.value()); }
+ *          return true;
+ *      });
+ *      ...
+ *      consumer.stop(true);//interrupts pop() and joins
+ */
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+namespace thread_utils
+{
+    class StopToken;
+
+    namespace detail
+    {
+        /**
+         * Intrusive node of a registered stop notification
+         */
+        struct StopWaiter
+        {
+            StopWaiter* next;
+            StopWaiter* prev;
+            bool        linked;
+            void        (*notify)(void* arg);
+            void*       arg;
+        };
+
+        struct StopState
+        {
+            std::mutex              mutex;
+            std::condition_variable callbackDone;
+            std::atomic_bool        stopped;
+            StopWaiter*             head;
+            StopWaiter*             running;
+            std::thread::id         requester;
+
+            StopState() : mutex(), callbackDone(), stopped(false), head(nullptr), running(nullptr), requester() {}
+
+            inline void unlink(StopWaiter* waiter)
+            {
+                if( waiter->prev ) { waiter->prev->next = waiter->next; }
+                else               { head = waiter->next; }
+                if( waiter->next ) { waiter->next->prev = waiter->prev; }
+                waiter->next = waiter->prev = nullptr;
+                waiter->linked = false;
+            }
+            /**
+             * @return False is returned if stop was already requested, the waiter is not registered then
+             */
+            bool attach(StopWaiter* waiter)
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+                if( stopped.load() ) { return false; }
+                waiter->prev = nullptr;
+                waiter->next = head;
+                if( head ) { head->prev = waiter; }
+                head = waiter;
+                waiter->linked = true;
+                return true;
+            }
+            /**
+             * Unregisters the waiter. If its notification is being executed on another thread then waits for it to finish.
+             */
+            void detach(StopWaiter* waiter)
+            {
+                std::unique_lock<std::mutex> locker(mutex);
+                if( waiter->linked )
+                {
+                    unlink(waiter);
+                    return;
+                }
+                if( requester != std::this_thread::get_id() )
+                {
+                    callbackDone.wait(locker, [&] { return running != waiter; });
+                }
+            }
+
+            bool request()
+            {
+                std::unique_lock<std::mutex> locker(mutex);
+                if( stopped.load() ) { return false; }
+                stopped.store(true);
+                requester = std::this_thread::get_id();
+                while( head )
+                {
+                    StopWaiter* waiter = head;
+                    unlink(waiter);
+                    running = waiter;
+                    //notifications are invoked unlocked, they may lock the mutex of the waiting primitive
+                    locker.unlock();
+                    waiter->notify(waiter->arg);
+                    locker.lock();
+                    running = nullptr;
+                    callbackDone.notify_all();
+                }
+                return true;
+            }
+        };
+
+        /**
+         * Registers a notification function that is invoked by StopSource::request_stop().
+         * Unlike StopCallback it is never invoked by the constructor (the caller may hold the lock the
+         * notification needs), callers have to check StopToken::stop_requested() after registration instead.
+         * The destructor must not be called while holding a lock that the notification acquires.
+         */
+        class StopNotifier final
+        {
+        public:
+            inline StopNotifier(const StopToken& token, void (*notify)(void* arg), void* arg);
+            inline ~StopNotifier();
+            StopNotifier(const StopNotifier&) = delete;
+            StopNotifier& operator=(const StopNotifier&) = delete;
+        private:
+            std::shared_ptr<StopState>  mState;
+            StopWaiter                  mWaiter;
+        };
+    }
+
+    class StopToken final
+    {
+    public:
+        /**
+         * Creates a token without an associated StopSource. Stop is never requested on it.
+         */
+        StopToken() : mState() {}
+        /**
+         * Returns true if stop was requested on the associated StopSource
+         */
+        inline bool stop_requested() const noexcept { return mState && mState->stopped.load(); }
+        /**
+         * Returns true if the token has an associated StopSource
+         */
+        inline bool stop_possible() const noexcept { return static_cast<bool>(mState); }
+    private:
+        friend class StopSource;
+        friend class StopCallback;
+        friend class detail::StopNotifier;
+        explicit StopToken(const std::shared_ptr<detail::StopState>& state) : mState(state) {}
+        std::shared_ptr<detail::StopState> mState;
+    };
+
+    class StopSource final
+    {
+    public:
+        StopSource() : mState(std::make_shared<detail::StopState>()) {}
+        /**
+         * Requests stop. Registered callbacks are invoked on the calling thread before this function returns.
+         * @return False is returned if stop was already requested
+         */
+        inline bool request_stop() { return mState->request(); }
+        /**
+         * Returns true if stop was requested
+         */
+        inline bool stop_requested() const noexcept { return mState->stopped.load(); }
+        /**
+         * Returns a token associated to this source
+         */
+        inline StopToken get_token() const noexcept { return StopToken(mState); }
+    private:
+        std::shared_ptr<detail::StopState> mState;
+    };
+
+    /**
+     * Invokes the given function when stop is requested on the token. If stop was already requested then
+     * the function is invoked by the constructor. The destructor waits for a running invocation to finish.
+     */
+    class StopCallback final
+    {
+    public:
+        StopCallback(const StopToken& token, const std::function<void ()>& callback)
+            : mState(token.mState), mWaiter(), mCallback(callback)
+        {
+            mWaiter.linked = false;
+            mWaiter.notify = &StopCallback::invoke;
+            mWaiter.arg = this;
+            if( mState && !mState->attach(&mWaiter) )
+            { mCallback(); }
+        }
+        ~StopCallback() { if( mState ) { mState->detach(&mWaiter); } }
+        StopCallback(const StopCallback&) = delete;
+        StopCallback& operator=(const StopCallback&) = delete;
+    private:
+        static void invoke(void* arg) { static_cast<StopCallback*>(arg)->mCallback(); }
+        std::shared_ptr<detail::StopState>  mState;
+        detail::StopWaiter                  mWaiter;
+        std::function<void ()>              mCallback;
+    };
+
+    detail::StopNotifier::StopNotifier(const StopToken& token, void (*notify)(void* arg), void* arg)
+        : mState(token.mState), mWaiter()
+    {
+        mWaiter.linked = false;
+        mWaiter.notify = notify;
+        mWaiter.arg = arg;
+        if( mState ) { mState->attach(&mWaiter); }
+    }
+
+    detail::StopNotifier::~StopNotifier()
+    {
+        if( mState ) { mState->detach(&mWaiter); }
+    }
+}
+
+#endif
@@ -1,14 +1,26 @@
 #include "thread.h"
+#include "trace.h"
+#include "futex.h"
+#include "thread_local.h"
 #include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 #include <signal.h>
 #include <syscall.h>
 #include <sched.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <limits.h>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
 
 static std::atomic_bool global_term_sig_handler_registered(false);
+static thread_local thread_utils::StopToken current_thread_stop_token;
 
 static void generalSignalHandler(int signum, siginfo_t * siginfo, void * arg)
 {
@@ -30,6 +42,36 @@ static int setSignalHandler(const int signum)
 namespace thread_utils
 {
 
+/**
+ * A thread can not hand back the stack it is running on. A detached thread finishing on an allocator's stack parks
+ * itself here, the next one joins it and hands its stack back (as does the start of a thread with an allocator).
+ */
+struct ParkedStack
+{
+    pthread_t       thread;
+    StackAllocator* allocator;
+    void*           memory;
+    size_t          size;
+};
+static std::mutex parked_stack_mutex;
+static ParkedStack parked_stack = {};
+
+static void parkStack(const ParkedStack& stack)
+{
+    ParkedStack previous;
+    {
+        std::lock_guard<std::mutex> guard(parked_stack_mutex);
+        previous = parked_stack;
+        parked_stack = stack;
+    }
+    if( previous.memory )
+    {
+        //it has left its cleanup handler, the join waits at most for the rest of its exit
+        pthread_join(previous.thread, NULL);
+        previous.allocator->deallocate(previous.memory, previous.size);
+    }
+}
+
 Thread::CleanupContext::CleanupContext(const std::shared_ptr<thread_utils::Thread::Context>& ctx) : context(ctx) {}
 
 void Thread::generalCleanupHandler(void * arg)
@@ -39,21 +81,46 @@ void Thread::generalCleanupHandler(void * arg)
     {
         if( cleanupContext->context->onCancelled )
         { cleanupContext->context->onCancelled(); }
-        cleanupContext->context->state.store(false);
+        THREAD_UTILS_TRACE_INSTANT("Thread::exit");
+        //fold the thread local slots before the thread is seen as finished (also if it was cancelled or killed)
+        detail::releaseThreadLocals();
+        finish(cleanupContext->context);
     }
     delete cleanupContext;
 }
 
+static void sleepUntilAbsolute(clockid_t clock_id, std::chrono::nanoseconds since_epoch)
+{
+    if( since_epoch.count() <= 0 ) { return; }
+    struct timespec deadline;
+    deadline.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+    deadline.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+    while( clock_nanosleep(clock_id, TIMER_ABSTIME, &deadline, NULL) == EINTR ) {}
+}
+
 void sleepFor(int64_t milliseconds)
 {
-    std::chrono::milliseconds ms{milliseconds};
-    std::this_thread::sleep_for(ms);
+    sleepFor(std::chrono::milliseconds(milliseconds));
 }
 
 void sleepUntil(int64_t timestamp_ms)
 {
-    int64_t now = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()).time_since_epoch().count();
-    sleepFor(timestamp_ms - now);
+    sleepUntil(std::chrono::steady_clock::time_point(std::chrono::milliseconds(timestamp_ms)));
+}
+
+void sleepUntil(const std::chrono::steady_clock::time_point& deadline, std::chrono::nanoseconds spin_tail)
+{
+    //the epoch of std::chrono::steady_clock is the one of CLOCK_MONOTONIC
+    sleepUntilAbsolute(CLOCK_MONOTONIC, std::chrono::duration_cast<std::chrono::nanoseconds>((deadline - spin_tail).time_since_epoch()));
+    if( spin_tail.count() > 0 )
+    {
+        while( std::chrono::steady_clock::now() < deadline ) { detail::cpuRelax(); }
+    }
+}
+
+void sleepUntil(const std::chrono::system_clock::time_point& deadline)
+{
+    sleepUntilAbsolute(CLOCK_REALTIME, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()));
 }
 
 void testCancel()
@@ -61,6 +128,11 @@ void testCancel()
     pthread_testcancel();
 }
 
+StopToken currentStopToken()
+{
+    return current_thread_stop_token;
+}
+
 Thread::Thread(const std::string& name) 
     : mContextMutex()
     , mContext(new Thread::Context(name))
@@ -78,12 +150,117 @@ Thread::~Thread()
     auto context = getContext();
     if( context )
     {
-        if( context->thread && context->thread->joinable() )
-        { context->thread->detach(); }
+        if( context->state.load() ) { detachContext(context); }
+        else                        { joinContext(context); } //finished, joining hands the stack back
         resetContext(nullptr);
     }
 }
 
+void Thread::joinContext(const std::shared_ptr<Context>& context)
+{
+    if( context->joinable.exchange(false) )
+    {
+        pthread_join(context->nativeHandle, NULL);
+        releaseStack(context);
+    }
+}
+
+void Thread::detachContext(const std::shared_ptr<Context>& context)
+{
+    if( context->joinable.exchange(false) )
+    {
+        if( context->stackMemory )
+        {
+            {
+                std::lock_guard<ProfiledMutex> guard(context->mutex);
+                //still running, it parks its stack in finish()
+                if( context->state.load() ) { context->detached = true; return; }
+            }
+            pthread_join(context->nativeHandle, NULL);
+            releaseStack(context);
+            return;
+        }
+        pthread_detach(context->nativeHandle);
+    }
+}
+
+void Thread::finish(const std::shared_ptr<Context>& context)
+{
+    bool detached = false;
+    {
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
+        detached = context->detached;
+        context->state.store(false);
+    }
+    if( detached )
+    {
+        ParkedStack stack;
+        stack.thread = pthread_self();
+        stack.allocator = context->stackAllocator;
+        stack.memory = context->stackMemory;
+        stack.size = context->stackMemorySize;
+        parkStack(stack);
+    }
+}
+
+void Thread::releaseStack(const std::shared_ptr<Context>& context)
+{
+    if( context->stackMemory )
+    {
+        context->stackAllocator->deallocate(context->stackMemory, context->stackMemorySize);
+        context->stackMemory = nullptr;
+    }
+}
+
+bool Thread::createThread(const std::shared_ptr<Context>& context)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    const StackOptions& stack = context->stack;
+    if( stack.allocator )
+    {
+        //hand back the stack of a finished detached thread first, it may be reused right away
+        parkStack(ParkedStack());
+        context->stackMemorySize = stack.size ? stack.size : stack.allocator->stackSize();
+        context->stackMemory = stack.allocator->allocate(context->stackMemorySize);
+        if( !context->stackMemory )
+        {
+            pthread_attr_destroy(&attr);
+            return false;
+        }
+        context->stackAllocator = stack.allocator;
+        //a stack the allocator got wrong (too small, misaligned) must not silently fall back to a default stack
+        if( pthread_attr_setstack(&attr, context->stackMemory, context->stackMemorySize) != 0 )
+        {
+            pthread_attr_destroy(&attr);
+            releaseStack(context);
+            return false;
+        }
+    } else {
+        if( stack.size ) { pthread_attr_setstacksize(&attr, stack.size); }
+        if( stack.guardSize != StackOptions::DEFAULT_GUARD_SIZE ) { pthread_attr_setguardsize(&attr, stack.guardSize); }
+    }
+
+    std::shared_ptr<Context>* arg = new std::shared_ptr<Context>(context);
+    bool res = (pthread_create(&context->nativeHandle, &attr, &Thread::threadEntry, arg) == 0);
+    pthread_attr_destroy(&attr);
+    if( res )
+    {
+        context->joinable.store(true);
+    } else {
+        delete arg;
+        releaseStack(context);
+    }
+    return res;
+}
+
+void* Thread::threadEntry(void* arg)
+{
+    std::unique_ptr<std::shared_ptr<Context>> context(static_cast<std::shared_ptr<Context>*>(arg));
+    threadFunction(*context);
+    return NULL;
+}
+
 bool Thread::run(const std::function<void ()>& function, const std::function<void ()>& on_cancel)
 {
     std::lock_guard<std::mutex> concurent_detach_or_run_guard(mContextMutex);
@@ -94,13 +271,17 @@ bool Thread::run(const std::function<void ()>& function, const std::function<voi
         auto new_context = std::make_shared<Context>(mName);
         if( context )
         {
-            std::lock_guard<std::mutex> guard(context->mutex);
+            //the previous thread has finished but may still be joinable
+            joinContext(context);
+            std::lock_guard<ProfiledMutex> guard(context->mutex);
             new_context->cpu_set = context->cpu_set;
             new_context->niceValue = context->niceValue;
+            new_context->timerSlackNs = context->timerSlackNs;
+            new_context->stack = context->stack;
         }
         new_context->function = function;
         new_context->onCancelled = on_cancel;
-        new_context->thread.reset(new std::thread(std::bind(&thread_utils::Thread::threadFunction, new_context)));
+        if( !createThread(new_context) ) { return false; }
         new_context->state.store(true);
         new_context->launchGate.post();
         resetContext(new_context);
@@ -117,15 +298,15 @@ const std::string& Thread::name() const noexcept
 bool Thread::joinable() const noexcept
 {
     auto context = getContext();
-    return ( context && context->state.load() && context->thread && context->thread->joinable() );
+    return ( context && context->state.load() && context->joinable.load() );
 }
 
 void Thread::join()
 {
     auto context = getContext();
-    if( context && context->state.load() && context->thread && context->thread->joinable() ) 
+    if( context ) 
     {
-        context->thread->join();
+        joinContext(context);
     }
 }
 
@@ -136,8 +317,7 @@ void Thread::detach()
     auto context = getContext();
     if( context ) //not detached
     { 
-        if( context->thread && context->thread->joinable() )
-        { context->thread->detach(); }
+        detachContext(context);
         resetContext(nullptr);
     }
 }
@@ -147,11 +327,11 @@ bool Thread::cancel()
     auto context = getContext();
     if( context && context->state.load() )//not detached and running
     { 
-        std::lock_guard<std::mutex> guard(context->mutex);
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
         context->killed = true;
         if(context->pid > 0)
         {
-            return (pthread_cancel(static_cast<pthread_t>(context->nativeHandle)) == 0);
+            return (pthread_cancel(context->nativeHandle) == 0);
         }
     }
     return true;
@@ -162,11 +342,11 @@ bool Thread::kill()
     auto context = getContext();
     if( context && context->state.load() )//not detached and running
     { 
-        std::lock_guard<std::mutex> guard(context->mutex);
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
         context->killed = true;
         if( context->pid > 0 )
         {
-            return pthread_kill(static_cast<pthread_t>(context->nativeHandle), SIGUSR2) == 0; 
+            return pthread_kill(context->nativeHandle, SIGUSR2) == 0; 
         }
     }
     return true;
@@ -189,6 +369,26 @@ static inline bool setaffinity(pid_t pid, const std::vector<int32_t>& cpu_number
     return res;
 }
 
+bool Thread::requestStop()
+{
+    auto context = getContext();
+    if( context && context->state.load() )//not detached and running
+    {
+        return context->stopSource.request_stop();
+    }
+    return false;
+}
+
+StopToken Thread::stopToken() const
+{
+    auto context = getContext();
+    if( context )
+    {
+        return context->stopSource.get_token();
+    }
+    return StopToken();
+}
+
 bool Thread::setAffinity(const std::vector<int32_t>& cpu_numbers)
 {
     if( cpu_numbers.empty() ) return false;
@@ -196,7 +396,7 @@ bool Thread::setAffinity(const std::vector<int32_t>& cpu_numbers)
     auto context = getContext();
     if( context )
     {
-        std::lock_guard<std::mutex> guard(context->mutex);
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
         context->cpu_set = cpu_numbers;
         if( context->state.load() && context->pid > 0 )
         {
@@ -213,7 +413,7 @@ bool Thread::setPriority(int32_t nice_value)
     auto context = getContext();
     if( context )
     {
-        std::lock_guard<std::mutex> guard(context->mutex);
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
         context->niceValue = nice_value;
         if( context->state.load() && (context->pid > 0) )
         {
@@ -227,30 +427,129 @@ bool Thread::setPriority(int32_t nice_value)
     return false;
 }
 
+static inline bool settimerslack(pid_t pid, uint64_t slack_ns)
+{
+    if( pid == static_cast<pid_t>(syscall(SYS_gettid)) )
+    {
+        return (prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(slack_ns), 0, 0, 0) == 0);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/timerslack_ns", static_cast<int>(pid));
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if( fd < 0 ) { return false; }
+    char value[32];
+    int length = snprintf(value, sizeof(value), "%llu", static_cast<unsigned long long>(slack_ns));
+    bool res = (write(fd, value, length) == length);
+    close(fd);
+    return res;
+}
+
+bool Thread::setTimerSlack(uint64_t slack_ns)
+{
+    auto context = getContext();
+    if( context )
+    {
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
+        context->timerSlackNs = static_cast<int64_t>(slack_ns);
+        if( context->state.load() && (context->pid > 0) )
+        {
+            return settimerslack(context->pid, slack_ns);
+        } else {
+            //timer slack will be set
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Thread::setStack(const StackOptions& options)
+{
+    if( options.size && (options.size < static_cast<size_t>(PTHREAD_STACK_MIN)) ) return false;
+
+    auto context = getContext();
+    if( context )
+    {
+        std::lock_guard<ProfiledMutex> guard(context->mutex);
+        context->stack = options;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Applies the huge page advice and prefaults the stack of the calling thread below the current frame
+ */
+static void prepareStack(bool huge_pages, bool prefault)
+{
+    pthread_attr_t attr;
+    if( pthread_getattr_np(pthread_self(), &attr) != 0 ) { return; }
+    void* stack_address = nullptr;
+    size_t stack_size = 0;
+    pthread_attr_getstack(&attr, &stack_address, &stack_size);
+    pthread_attr_destroy(&attr);
+
+    const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t low = (reinterpret_cast<uintptr_t>(stack_address) + page_size - 1) & ~(page_size - 1);
+    //leave the pages of the current frames alone
+    const uintptr_t high = (reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) & ~(page_size - 1)) - page_size;
+    if( high <= low ) { return; }
+#ifdef MADV_HUGEPAGE
+    if( huge_pages ) { madvise(reinterpret_cast<void*>(low), high - low, MADV_HUGEPAGE); }
+#endif
+    if( prefault )
+    {
+#ifdef MADV_POPULATE_WRITE
+        if( madvise(reinterpret_cast<void*>(low), high - low, MADV_POPULATE_WRITE) == 0 ) { return; }
+#endif
+        //nothing lives below the current frame yet, a signal handler running meanwhile is done before the loop resumes
+        for(uintptr_t page = low; page < high; page += page_size)
+        { *reinterpret_cast<volatile char*>(page) = 0; }
+    }
+}
+
 void Thread::threadFunction(const std::shared_ptr<Thread::Context>& context)
 {
     if( context )
     {
         context->launchGate.wait();
+        bool huge_pages = false;
+        bool prefault = false;
         {
-            std::lock_guard<std::mutex> guard(context->mutex);
+            std::unique_lock<ProfiledMutex> guard(context->mutex);
             if( context->killed ) //killed
             {
                 if( context->onCancelled ) { context->onCancelled(); }
-                context->state.store(false);
+                guard.unlock();
+                finish(context);
                 return;
             }
-            context->nativeHandle = context->thread->native_handle();
             context->pid = static_cast<pid_t>(syscall(SYS_gettid));
             if( !context->cpu_set.empty() )
             {
                 setaffinity(0, context->cpu_set);
             }
             setpriority(PRIO_PROCESS, 0, context->niceValue);
+            if( context->timerSlackNs >= 0 )
+            {
+                prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(context->timerSlackNs), 0, 0, 0);
+            }
+            huge_pages = context->stack.hugePages;
+            prefault = context->stack.prefault;
         }
+        //after the affinity, so the pages are allocated local to the cpus of the thread
+        if( huge_pages || prefault ) { prepareStack(huge_pages, prefault); }
 
         if( !context->name.empty() )
-        { pthread_setname_np(static_cast<pthread_t>(context->thread->native_handle()), context->name.c_str()); }
+        { pthread_setname_np(pthread_self(), context->name.c_str()); }
+#ifdef THREAD_UTILS_TRACING
+        if( Tracer::enabled() )
+        {
+            Tracer::setThreadName(context->name.c_str());
+            Tracer::instant("Thread::start");
+        }
+#endif
+
+        current_thread_stop_token = context->stopSource.get_token();
 
         int old_cancel_state = 0;
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancel_state);
@@ -267,17 +566,25 @@ void Thread::threadFunction(const std::shared_ptr<Thread::Context>& context)
 }
 
 Thread::Context::Context(const std::string& _name)
-    : mutex()
+    : mutex("Thread::Context")
     , pid(0)
-    , nativeHandle(0)
+    , nativeHandle()
     , killed(false)
-    , thread()
+    , joinable(false)
+    , stack()
+    , stackAllocator(nullptr)
+    , detached(false)
+    , stackMemory(nullptr)
+    , stackMemorySize(0)
     , state(false)
     , function()
     , onCancelled()
     , niceValue(0)
+    , timerSlackNs(-1)
     , name(_name)
     , cpu_set()
+    , launchGate()
+    , stopSource()
 {}
 
 }//thread_utils end
@@ -8,8 +8,14 @@
 #include <atomic>
 #include <memory>
 #include <vector>
+#include <chrono>
+
+#include <pthread.h>
 
 #include "semaphore.h"
+#include "stop_token.h"
+#include "profiled_mutex.h"
+#include "stack_pool.h"
 
 namespace thread_utils
 {
@@ -23,12 +29,70 @@ namespace thread_utils
      * @param timestamp_ms
      */
     void sleepUntil(int64_t timestamp_ms);
+    /**
+     * Sleeps the current thread until the given steady clock time. The deadline is absolute (clock_nanosleep with
+     * TIMER_ABSTIME on CLOCK_MONOTONIC), so periodic sleeps do not drift.
+     * @param deadline
+     * @param spin_tail The last part of the wait is spent spinning instead of sleeping. Useful for deadlines tighter
+     * than the timer slack and the wakeup latency of the scheduler (roughly 50 microseconds). Default value: zero
+     */
+    void sleepUntil(const std::chrono::steady_clock::time_point& deadline, std::chrono::nanoseconds spin_tail = std::chrono::nanoseconds::zero());
+    /**
+     * Sleeps the current thread until the given wall clock time (CLOCK_REALTIME), follows adjustments of the system clock
+     * @param deadline
+     */
+    void sleepUntil(const std::chrono::system_clock::time_point& deadline);
+    /**
+     * Sleeps the current thread for the given duration of any precision
+     * @param duration
+     * @param spin_tail See sleepUntil(). Default value: zero
+     */
+    template<typename Rep, typename Period>
+    inline void sleepFor(const std::chrono::duration<Rep, Period>& duration, std::chrono::nanoseconds spin_tail = std::chrono::nanoseconds::zero())
+    { sleepUntil(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration), spin_tail); }
     /**
      * Calling testCancel() creates a cancellation point within the calling thread.
      * If the calling thread is canceled as a consequence of a call to this function, then the function does not return.
      * Instead an 'on exit' event callback is invoked. See Thread::run() 
      */
     void testCancel();
+    /**
+     * Returns the stop token of the Thread running the calling function. See Thread::requestStop()
+     * If the caller is not running on a Thread then a token without an associated StopSource is returned.
+     */
+    StopToken currentStopToken();
+
+    /**
+     * Stack configuration of a Thread, see Thread::setStack()
+     */
+    struct StackOptions
+    {
+        static const size_t DEFAULT_GUARD_SIZE = static_cast<size_t>(-1);
+        /**
+         * Size of the stack, 0 selects the default of the system (ulimit -s, usually 8 MiB of address space).
+         * Small stacks let many threads fit into less address space and page table memory.
+         */
+        size_t          size = 0;
+        /**
+         * Size of the guard area below the stack, 0 disables it. Ignored if the stack comes from an allocator.
+         */
+        size_t          guardSize = DEFAULT_GUARD_SIZE;
+        /**
+         * Advises transparent huge pages for the stack (MADV_HUGEPAGE)
+         */
+        bool            hugePages = false;
+        /**
+         * Populates the whole stack before the thread function is invoked (after the affinity is applied, so the
+         * memory is local to the cpus of the thread), deep calls take no first-touch page faults later
+         */
+        bool            prefault = false;
+        /**
+         * Provides the stack memory if set (e.g. a StackPool), the memory is handed back when the thread is joined.
+         * The stack of a detached thread is handed back once the next detached thread finishes or the next thread
+         * with an allocator is started, a thread can not release the stack it is still running on.
+         */
+        StackAllocator* allocator = nullptr;
+    };
 
     class Thread final
     {
@@ -77,6 +141,18 @@ namespace thread_utils
          * @return False is returned if failed to initiate termination request, otherwise true.
          */
         bool kill();
+        /**
+         * Requests the thread function to stop cooperatively. Blocking calls waiting with the token of the thread
+         * (see stopToken() and currentStopToken()) return promptly. Unlike cancel() and kill() it does not unwind
+         * the thread, so no lock is left held.
+         * @return False is returned if there is no running thread or stop was already requested, otherwise true.
+         */
+        bool requestStop();
+        /**
+         * Returns the stop token of the current (or last) run of the thread.
+         * Every run() creates a new stop source.
+         */
+        StopToken stopToken() const;
         /**
          * Sets the soft priority(nice value)
          * @param nice_value An integer representing priority level in the range of -20 to 19 where -20 is the highest priority.
@@ -89,21 +165,44 @@ namespace thread_utils
          * @return True is returned if affinity setting can be applied, otherwise false.
          */
         bool setAffinity(const std::vector<int32_t>& cpu_numbers);
+        /**
+         * Sets the timer slack of the thread (PR_SET_TIMERSLACK): the amount of time the kernel may delay its timed
+         * wakeups to coalesce them with others. Lower values make short sleeps and timeouts more precise at the
+         * cost of more wakeups, higher values save power. The setting is kept for the following runs.
+         * Changing it on a running thread from another thread requires Linux 4.6 (/proc/<tid>/timerslack_ns) and
+         * CAP_SYS_NICE, without the capability it fails with errno EPERM and only the following runs get the setting.
+         * @param slack_ns Slack in nanoseconds, 0 restores the default slack of the thread
+         * @return True is returned if the timer slack can be applied, otherwise false (errno is set).
+         */
+        bool setTimerSlack(uint64_t slack_ns);
+        /**
+         * Sets the stack configuration of the following runs
+         * @param options
+         * @return False is returned if the stack size is smaller than PTHREAD_STACK_MIN, otherwise true.
+         */
+        bool setStack(const StackOptions& options);
     private:
         struct Context
         {
-            mutable std::mutex                              mutex;
+            mutable ProfiledMutex                           mutex;
             std::atomic<pid_t>                              pid;
-            std::thread::native_handle_type                 nativeHandle;
+            pthread_t                                       nativeHandle;
             bool                                            killed;
-            std::unique_ptr<std::thread>                    thread;
+            std::atomic_bool                                joinable;
+            StackOptions                                    stack;
+            StackAllocator*                                 stackAllocator;//allocator of stackMemory
+            bool                                            detached;//detached while running on stackMemory
+            void*                                           stackMemory;
+            size_t                                          stackMemorySize;
             std::atomic_bool                                state;
             std::function<void ()>                          function;
             std::function<void ()>                          onCancelled;
             int32_t                                         niceValue;
+            int64_t                                         timerSlackNs;//negative: not set
             std::string                                     name;
             std::vector<int32_t>                            cpu_set;
             binary_semaphore_t                              launchGate;
+            StopSource                                      stopSource;
             Context(const std::string& _name);
         };
 
@@ -118,7 +217,13 @@ namespace thread_utils
         std::shared_ptr<Context> mContext;
         const std::string        mName;//redundant information on purpose
 
+        static bool createThread(const std::shared_ptr<Context>& context);
+        static void* threadEntry(void* arg);
         static void threadFunction(const std::shared_ptr<Context>& context);
+        static void joinContext(const std::shared_ptr<Context>& context);
+        static void detachContext(const std::shared_ptr<Context>& context);
+        static void finish(const std::shared_ptr<Context>& context);//called by the thread when it returns or is cancelled
+        static void releaseStack(const std::shared_ptr<Context>& context);//after the thread is joined
         inline void resetContext(const std::shared_ptr<Context>& ctx)
         { std::atomic_store<Context>(&mContext, ctx); }
         inline std::shared_ptr<Thread::Context> getContext() const
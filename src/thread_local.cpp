@@ -0,0 +1,122 @@
+#include "thread_local.h"
+#include <vector>
+
+namespace
+{
+    /**
+     * Slots of the calling thread indexed by ThreadLocal index, released on thread exit
+     */
+    struct ThreadSlots
+    {
+        std::vector<thread_utils::detail::ThreadLocalSlot*> slots;
+        ~ThreadSlots() { thread_utils::detail::releaseThreadLocals(); }
+    };
+
+    thread_local ThreadSlots thread_slots;
+
+    //guarded by the registry mutex
+    size_t next_index = 0;
+    uint64_t next_serial = 0;
+}
+
+namespace thread_utils
+{
+namespace detail
+{
+
+/**
+ * Indices of destroyed ThreadLocals, guarded by the registry mutex. Never destroyed: threads may exit during static destruction
+ */
+static std::vector<size_t>& freeIndices()
+{
+    static std::vector<size_t>* indices = new std::vector<size_t>();
+    return *indices;
+}
+
+std::mutex& ThreadLocalBase::registryMutex()
+{
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+ThreadLocalSlot* const* ThreadLocalBase::threadSlots(size_t index)
+{
+    std::vector<ThreadLocalSlot*>& slots = thread_slots.slots;
+    return (index < slots.size()) ? &slots[index] : nullptr;
+}
+
+ThreadLocalBase::ThreadLocalBase(retire_t retire)
+    : mRetire(retire)
+    , mIndex(0)
+    , mSerial(0)
+    , mHead(nullptr)
+{
+    std::lock_guard<std::mutex> guard(registryMutex());
+    std::vector<size_t>& free_indices = freeIndices();
+    if( free_indices.empty() )
+    {
+        mIndex = next_index++;
+    } else {
+        mIndex = free_indices.back();
+        free_indices.pop_back();
+    }
+    mSerial = ++next_serial;
+}
+
+ThreadLocalBase::~ThreadLocalBase()
+{
+    orphan();
+    std::lock_guard<std::mutex> guard(registryMutex());
+    freeIndices().push_back(mIndex);
+}
+
+ThreadLocalSlot* ThreadLocalBase::attach(ThreadLocalSlot* slot)
+{
+    std::vector<ThreadLocalSlot*>& slots = thread_slots.slots;
+    ThreadLocalSlot* stale = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(registryMutex());
+        slot->owner = this;
+        slot->serial = mSerial;
+        slot->prev = nullptr;
+        slot->next = mHead;
+        if( mHead ) { mHead->prev = slot; }
+        mHead = slot;
+        if( slots.size() <= mIndex ) { slots.resize(mIndex + 1, nullptr); }
+        //a previous slot at this index belongs to a destroyed ThreadLocal (indices are reused)
+        stale = slots[mIndex];
+        slots[mIndex] = slot;
+    }
+    delete stale;
+    return slot;
+}
+
+void ThreadLocalBase::orphan()
+{
+    std::lock_guard<std::mutex> guard(registryMutex());
+    for(ThreadLocalSlot* slot = mHead; slot; slot = slot->next)
+    { slot->owner = nullptr; }
+    mHead = nullptr;
+}
+
+void releaseThreadLocals()
+{
+    std::vector<ThreadLocalSlot*> released;
+    {
+        std::lock_guard<std::mutex> guard(ThreadLocalBase::registryMutex());
+        released.swap(thread_slots.slots);
+        for(ThreadLocalSlot* slot : released)
+        {
+            if( !slot || !slot->owner ) { continue; }
+            ThreadLocalBase* owner = slot->owner;
+            owner->mRetire(owner, slot);
+            if( slot->prev ) { slot->prev->next = slot->next; }
+            else             { owner->mHead = slot->next; }
+            if( slot->next ) { slot->next->prev = slot->prev; }
+        }
+    }
+    for(ThreadLocalSlot* slot : released) { delete slot; }
+}
+
+}//detail end
+}//thread_utils end
@@ -0,0 +1,214 @@
+#ifndef _THREAD_LOCAL_H_
+#define _THREAD_LOCAL_H_
+
+/**
+ * C++11 required for compilation
+ * Per-object thread local storage with cross-thread aggregation.
+ *
+ * Every thread accessing a ThreadLocal gets its own cache line aligned slot, allocated on first access. Access after
+ * the first one is a lookup in a vector of the calling thread without locking. for_each() visits the slots of every
+ * live thread under a registry mutex taken only by the first access of a thread, by thread exit and by aggregation,
+ * so writers are never stopped. Slots are released on thread exit (also for Threads cancelled or killed, see
+ * Thread::run()), an optional callback folds their value into the owner first.
+ *
+ * ShardedCounter is a statistics counter on top of it: an increment is a relaxed store to a slot no other thread writes.
+ *
+ * Example:
+ *
+ *      thread_utils::ShardedCounter processed;
+ *      ...any thread:
+ *      processed.increment();
+ *      ...reporting thread:
+ *      printf("processed: %lld\n", static_cast<long long>(processed.sum()));
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace thread_utils
+{
+    namespace detail
+    {
+        class ThreadLocalBase;
+
+        /**
+         * Slot of one thread, owned by that thread
+         */
+        struct ThreadLocalSlot
+        {
+            ThreadLocalBase*    owner;//nullptr if the ThreadLocal was destroyed before the thread released the slot
+            uint64_t            serial;
+            ThreadLocalSlot*    prev;
+            ThreadLocalSlot*    next;
+
+            ThreadLocalSlot() : owner(nullptr), serial(0), prev(nullptr), next(nullptr) {}
+            virtual ~ThreadLocalSlot() {}
+            /**
+             * Slots are cache line aligned, so two threads never write the same line
+             */
+            static void* operator new(size_t size)
+            {
+                void* pointer = nullptr;
+                if( posix_memalign(&pointer, 64, size) != 0 ) { throw std::bad_alloc(); }
+                return pointer;
+            }
+            static void operator delete(void* pointer) { free(pointer); }
+        };
+
+        class ThreadLocalBase
+        {
+        public:
+            ThreadLocalBase(const ThreadLocalBase&) = delete;
+            ThreadLocalBase& operator=(const ThreadLocalBase&) = delete;
+        protected:
+            typedef void (*retire_t)(ThreadLocalBase* owner, ThreadLocalSlot* slot);
+
+            explicit ThreadLocalBase(retire_t retire);
+            ~ThreadLocalBase();
+            /**
+             * Returns the slot of the calling thread or nullptr if it has none yet. Lock free.
+             */
+            inline ThreadLocalSlot* find() const
+            {
+                ThreadLocalSlot* const* slots = threadSlots(mIndex);
+                if( slots && *slots && ((*slots)->serial == mSerial) ) { return *slots; }
+                return nullptr;
+            }
+            /**
+             * Registers the given new slot as the slot of the calling thread
+             */
+            ThreadLocalSlot* attach(ThreadLocalSlot* slot);
+            /**
+             * Detaches the slots of every thread, they are freed by their threads. Called by the destructor of the
+             * derived class, so no retire callback runs on a partially destroyed object.
+             */
+            void orphan();
+            /**
+             * Mutex of every ThreadLocal, guards the slot lists
+             */
+            static std::mutex& registryMutex();
+            /**
+             * Returns the address of the entry of the calling thread at the given index or nullptr if the vector
+             * of the thread is shorter
+             */
+            static ThreadLocalSlot* const* threadSlots(size_t index);
+
+            const retire_t      mRetire;
+            size_t              mIndex;
+            uint64_t            mSerial;
+            ThreadLocalSlot*    mHead;
+
+            friend void releaseThreadLocals();
+        };
+        /**
+         * Releases the slots of the calling thread, retiring them to their owners.
+         * Invoked on thread exit, a later access allocates new slots.
+         */
+        void releaseThreadLocals();
+    }
+
+    template<typename T>
+    class ThreadLocal final : public detail::ThreadLocalBase
+    {
+    public:
+        /**
+         * @param on_thread_exit Optional callback invoked with the value of a thread when the thread exits, e.g. to fold
+         * it into a total. It runs on the exiting thread under the registry mutex, it must not access any ThreadLocal.
+         */
+        explicit ThreadLocal(const std::function<void (T& value)>& on_thread_exit = nullptr)
+            : ThreadLocalBase(&ThreadLocal::retire), mOnThreadExit(on_thread_exit)
+        {}
+        ~ThreadLocal() { orphan(); }
+        /**
+         * Returns the value of the calling thread, value-initialized on first access
+         */
+        inline T& local()
+        {
+            detail::ThreadLocalSlot* slot = find();
+            if( !slot ) { slot = attach(new Slot()); }
+            return static_cast<Slot*>(slot)->value;
+        }
+        inline T& operator*()   { return local(); }
+        inline T* operator->()  { return &local(); }
+        /**
+         * Invokes the given function with the value of every thread having a slot. The values may be written
+         * concurrently by their threads, so T should be read atomically (e.g. std::atomic members).
+         */
+        template<typename F>
+        void for_each(F function) const
+        {
+            std::lock_guard<std::mutex> guard(registryMutex());
+            for(detail::ThreadLocalSlot* slot = mHead; slot; slot = slot->next)
+            { function(static_cast<const Slot*>(slot)->value); }
+        }
+    private:
+        struct Slot : public detail::ThreadLocalSlot
+        {
+            T value;
+            Slot() : detail::ThreadLocalSlot(), value() {}
+        };
+
+        static void retire(detail::ThreadLocalBase* owner, detail::ThreadLocalSlot* slot)
+        {
+            ThreadLocal* self = static_cast<ThreadLocal*>(owner);
+            if( self->mOnThreadExit ) { self->mOnThreadExit(static_cast<Slot*>(slot)->value); }
+        }
+
+        const std::function<void (T& value)> mOnThreadExit;
+    };
+
+    /**
+     * Counter sharded per thread. add() touches only the slot of the calling thread, sum() adds the slots of the live
+     * threads and the values of the exited ones.
+     */
+    class ShardedCounter final : public detail::ThreadLocalBase
+    {
+    public:
+        ShardedCounter() : ThreadLocalBase(&ShardedCounter::retire), mRetired(0) {}
+        ~ShardedCounter() { orphan(); }
+        /**
+         * Adds the given value, only the calling thread writes its slot so a relaxed store is enough
+         */
+        inline void add(int64_t value)
+        {
+            detail::ThreadLocalSlot* slot = find();
+            if( !slot ) { slot = attach(new Cell()); }
+            std::atomic<int64_t>& count = static_cast<Cell*>(slot)->count;
+            count.store(count.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+        inline void increment() { add(1); }
+        inline void decrement() { add(-1); }
+        /**
+         * Returns the total of every thread. Concurrent adds may or may not be included.
+         */
+        int64_t sum() const
+        {
+            //exiting threads fold their slot under the same lock, so no value is counted twice or missed
+            std::lock_guard<std::mutex> guard(registryMutex());
+            int64_t total = mRetired;
+            for(detail::ThreadLocalSlot* slot = mHead; slot; slot = slot->next)
+            { total += static_cast<const Cell*>(slot)->count.load(std::memory_order_relaxed); }
+            return total;
+        }
+    private:
+        struct Cell : public detail::ThreadLocalSlot
+        {
+            std::atomic<int64_t> count;
+            Cell() : detail::ThreadLocalSlot(), count(0) {}
+        };
+
+        static void retire(detail::ThreadLocalBase* owner, detail::ThreadLocalSlot* slot)
+        {
+            static_cast<ShardedCounter*>(owner)->mRetired += static_cast<Cell*>(slot)->count.load(std::memory_order_relaxed);
+        }
+
+        int64_t mRetired;//guarded by the registry mutex
+    };
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include "trace.h"
+#include <unistd.h>
+#include <syscall.h>
+#include <pthread.h>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        uint64_t    timestampNs;
+        const char* name;
+        int64_t     value;
+        char        phase;//Chrome trace event phase: 'B' begin, 'E' end, 'i' instant, 'C' counter
+    };
+
+    /**
+     * Single producer ring buffer. Only the owner thread writes it, readers take a snapshot of mHead.
+     */
+    class TraceBuffer
+    {
+    public:
+        TraceBuffer(size_t capacity, pid_t tid)
+            : mEvents(capacity), mMask(capacity - 1), mHead(0), mTail(0), mTid(tid), mNameMutex(), mName(), mExited(false)
+        {
+            char name[16] = {0};
+            if( pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 ) { mName = name; }
+        }
+
+        inline void write(const char* name, char phase, int64_t value)
+        {
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            TraceEvent& event = mEvents[head & mMask];
+            event.timestampNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+            event.name = name;
+            event.value = value;
+            event.phase = phase;
+            mHead.store(head + 1, std::memory_order_release);
+        }
+
+        void setName(const char* name)
+        {
+            std::lock_guard<std::mutex> guard(mNameMutex);
+            mName = name;
+        }
+
+        std::string name() const
+        {
+            std::lock_guard<std::mutex> guard(mNameMutex);
+            return mName;
+        }
+
+        inline pid_t tid() const                { return mTid; }
+        inline void clear()                     { mTail.store(mHead.load(std::memory_order_acquire)); }
+        inline void setExited()                 { mExited.store(true); }
+        inline bool exited() const              { return mExited.load(); }
+
+        /**
+         * Copies the events that are still in the buffer
+         */
+        void snapshot(std::vector<TraceEvent>& events) const
+        {
+            uint64_t head = mHead.load(std::memory_order_acquire);
+            uint64_t tail = mTail.load();
+            if( head - tail > mEvents.size() ) { tail = head - mEvents.size(); }
+            events.clear();
+            for(uint64_t i = tail; i < head; ++i) { events.push_back(mEvents[i & mMask]); }
+        }
+    private:
+        std::vector<TraceEvent> mEvents;
+        const uint64_t          mMask;
+        std::atomic<uint64_t>   mHead;
+        std::atomic<uint64_t>   mTail;
+        const pid_t             mTid;
+        mutable std::mutex      mNameMutex;
+        std::string             mName;
+        std::atomic_bool        mExited;
+    };
+
+    /**
+     * Marks the buffer of an exited thread, so clear() can release it
+     */
+    struct TraceBufferOwner
+    {
+        std::shared_ptr<TraceBuffer> buffer;
+        ~TraceBufferOwner() { if( buffer ) { buffer->setExited(); } }
+    };
+
+    std::mutex& registryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<std::shared_ptr<TraceBuffer>>& registry()
+    {
+        static std::vector<std::shared_ptr<TraceBuffer>>* buffers = new std::vector<std::shared_ptr<TraceBuffer>>();
+        return *buffers;
+    }
+
+    std::atomic<size_t> buffer_capacity(16384);
+    thread_local TraceBuffer* current_buffer = nullptr;
+
+    TraceBuffer* createBuffer()
+    {
+        static thread_local TraceBufferOwner owner;
+        owner.buffer = std::make_shared<TraceBuffer>(buffer_capacity.load(), static_cast<pid_t>(syscall(SYS_gettid)));
+        {
+            std::lock_guard<std::mutex> guard(registryMutex());
+            registry().push_back(owner.buffer);
+        }
+        current_buffer = owner.buffer.get();
+        return current_buffer;
+    }
+
+    inline TraceBuffer* buffer()
+    {
+        return current_buffer ? current_buffer : createBuffer();
+    }
+
+    void writeJsonString(FILE* out, const char* str)
+    {
+        fputc('"', out);
+        for(; str && *str; ++str)
+        {
+            if( (*str == '"') || (*str == '\\') )   { fputc('\\', out); fputc(*str, out); }
+            else if( static_cast<unsigned char>(*str) < 0x20 ) { fprintf(out, "\\u%04x", *str); }
+            else                                    { fputc(*str, out); }
+        }
+        fputc('"', out);
+    }
+}
+
+namespace thread_utils
+{
+
+void Tracer::setBufferCapacity(size_t events)
+{
+    size_t capacity = 1;
+    while( capacity < events ) { capacity <<= 1; }
+    buffer_capacity.store(capacity);
+}
+
+void Tracer::begin(const char* name)                    { buffer()->write(name, 'B', 0); }
+void Tracer::end(const char* name)                      { buffer()->write(name, 'E', 0); }
+void Tracer::instant(const char* name)                  { buffer()->write(name, 'i', 0); }
+void Tracer::counter(const char* name, int64_t value)   { buffer()->write(name, 'C', value); }
+void Tracer::setThreadName(const char* name)            { buffer()->setName(name); }
+
+bool Tracer::writeChromeTrace(const std::string& path)
+{
+    FILE* out = fopen(path.c_str(), "w");
+    if( !out ) { return false; }
+    writeChromeTrace(out);
+    fclose(out);
+    return true;
+}
+
+void Tracer::writeChromeTrace(FILE* out)
+{
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> guard(registryMutex());
+        buffers = registry();
+    }
+
+    const int pid = static_cast<int>(getpid());
+    bool first = true;
+    std::vector<TraceEvent> events;
+    fprintf(out, "{\"traceEvents\":[\n");
+    for(const auto& trace_buffer : buffers)
+    {
+        const int tid = static_cast<int>(trace_buffer->tid());
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", pid, tid);
+        writeJsonString(out, trace_buffer->name().c_str());
+        fprintf(out, "}}");
+        first = false;
+
+        trace_buffer->snapshot(events);
+        for(const auto& event : events)
+        {
+            fprintf(out, ",\n{\"name\":");
+            writeJsonString(out, event.name);
+            fprintf(out, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d", event.phase,
+                    static_cast<unsigned long long>(event.timestampNs / 1000), static_cast<unsigned>(event.timestampNs % 1000), pid, tid);
+            if( event.phase == 'C' )        { fprintf(out, ",\"args\":{\"value\":%lld}", static_cast<long long>(event.value)); }
+            else if( event.phase == 'i' )   { fprintf(out, ",\"s\":\"t\""); }
+            fprintf(out, "}");
+        }
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> guard(registryMutex());
+    auto& buffers = registry();
+    for(auto it = buffers.begin(); it != buffers.end();)
+    {
+        if( (*it)->exited() )   { it = buffers.erase(it); }
+        else                    { (*it)->clear(); ++it; }
+    }
+}
+
+}//thread_utils end
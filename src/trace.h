@@ -0,0 +1,119 @@
+#ifndef _THREAD_UTILS_TRACE_H_
+#define _THREAD_UTILS_TRACE_H_
+
+/**
+ * Timeline tracing with per-thread ring buffers.
+ *
+ * Tracing is compiled in only if THREAD_UTILS_TRACING is defined (e.g. -DTHREAD_UTILS_TRACING), otherwise the
+ * THREAD_UTILS_TRACE_* macros expand to nothing. Every thread records into its own lock-free ring buffer, so the
+ * write path shares nothing between threads. When a buffer is full the oldest events are overwritten.
+ *
+ * Built-in events: Thread::start, Thread::exit, BlockingQueue::push, BlockingQueue::pop and
+ * Semaphore::wait spans covering the time a thread was blocked on a semaphore.
+ *
+ * Names are not copied, they must be string literals (or have static lifetime).
+ *
+ * Example:
+ *
+ *      void process(const Request& request)
+ *      {
+ *          THREAD_UTILS_TRACE_SCOPE("process");
+ *          ...
+ *          THREAD_UTILS_TRACE_COUNTER("pending", pending_count);
+ *      }
+ *      ...
+ *      thread_utils::Tracer::writeChromeTrace("trace.json");//open with chrome://tracing or ui.perfetto.dev
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <atomic>
+
+namespace thread_utils
+{
+    class Tracer final
+    {
+    public:
+        /**
+         * Enables or disables recording at runtime. Recording is enabled by default.
+         */
+        static void setEnabled(bool enabled) { enabledFlag().store(enabled, std::memory_order_relaxed); }
+        static inline bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+        /**
+         * Sets the number of events of the ring buffers created after this call. It is rounded up to a power of two.
+         * Default value: 16384
+         */
+        static void setBufferCapacity(size_t events);
+        /**
+         * Begins a span on the calling thread
+         */
+        static void begin(const char* name);
+        /**
+         * Ends the last span of the calling thread
+         */
+        static void end(const char* name);
+        /**
+         * Records an instant event on the calling thread
+         */
+        static void instant(const char* name);
+        /**
+         * Records the value of a counter
+         */
+        static void counter(const char* name, int64_t value);
+        /**
+         * Sets the track name of the calling thread. Buffers are labeled with the name set by pthread_setname_np() by default.
+         */
+        static void setThreadName(const char* name);
+        /**
+         * Writes every recorded event in Chrome trace event JSON format (loadable by chrome://tracing and ui.perfetto.dev)
+         * Dump while the traced threads are idle or tracing is disabled to avoid reading events that are being overwritten.
+         * @return False is returned if the file can not be opened
+         */
+        static bool writeChromeTrace(const std::string& path);
+        static void writeChromeTrace(FILE* out);
+        /**
+         * Discards the recorded events and the buffers of finished threads
+         */
+        static void clear();
+    private:
+        static std::atomic_bool& enabledFlag()
+        {
+            static std::atomic_bool flag(true);
+            return flag;
+        }
+    };
+
+    /**
+     * Records a span from construction to destruction
+     */
+    class TraceScope final
+    {
+    public:
+        explicit TraceScope(const char* name) : mName(name) { if( Tracer::enabled() ) { Tracer::begin(mName); } }
+        ~TraceScope() { if( Tracer::enabled() ) { Tracer::end(mName); } }
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+    private:
+        const char* mName;
+    };
+}
+
+#define THREAD_UTILS_TRACE_CONCAT_(a, b) a##b
+#define THREAD_UTILS_TRACE_CONCAT(a, b) THREAD_UTILS_TRACE_CONCAT_(a, b)
+
+#ifdef THREAD_UTILS_TRACING
+#define THREAD_UTILS_TRACE_SCOPE(name)          thread_utils::TraceScope THREAD_UTILS_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define THREAD_UTILS_TRACE_BEGIN(name)          do { if( thread_utils::Tracer::enabled() ) { thread_utils::Tracer::begin(name); } } while(0)
+#define THREAD_UTILS_TRACE_END(name)            do { if( thread_utils::Tracer::enabled() ) { thread_utils::Tracer::end(name); } } while(0)
+#define THREAD_UTILS_TRACE_INSTANT(name)        do { if( thread_utils::Tracer::enabled() ) { thread_utils::Tracer::instant(name); } } while(0)
+#define THREAD_UTILS_TRACE_COUNTER(name, value) do { if( thread_utils::Tracer::enabled() ) { thread_utils::Tracer::counter(name, value); } } while(0)
+#else
+#define THREAD_UTILS_TRACE_SCOPE(name)          do {} while(0)
+#define THREAD_UTILS_TRACE_BEGIN(name)          do {} while(0)
+#define THREAD_UTILS_TRACE_END(name)            do {} while(0)
+#define THREAD_UTILS_TRACE_INSTANT(name)        do {} while(0)
+#define THREAD_UTILS_TRACE_COUNTER(name, value) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#include "watchdog.h"
+#include "loop_thread.h"
+#include "trace.h"
+#include <unistd.h>
+#include <syscall.h>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <algorithm>
+
+namespace
+{
+    const int MAX_FRAMES = 64;
+    enum CaptureState { CAPTURE_IDLE, CAPTURE_REQUESTED, CAPTURE_WRITING, CAPTURE_DONE };
+
+    //one capture at a time: only the monitor thread requests captures
+    std::atomic<int>    capture_state(CAPTURE_IDLE);
+    void*               capture_frames[MAX_FRAMES];
+    int                 capture_depth = 0;
+
+    void captureHandler(int)
+    {
+        int expected = CAPTURE_REQUESTED;
+        if( capture_state.compare_exchange_strong(expected, CAPTURE_WRITING) )
+        {
+            capture_depth = backtrace(capture_frames, MAX_FRAMES);
+            capture_state.store(CAPTURE_DONE, std::memory_order_release);
+        }
+    }
+
+    std::vector<std::string> captureStack(pid_t tid, int signum)
+    {
+        std::vector<std::string> stack;
+        capture_state.store(CAPTURE_REQUESTED);
+        if( syscall(SYS_tgkill, getpid(), tid, signum) != 0 )
+        {
+            capture_state.store(CAPTURE_IDLE);
+            return stack;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        while( (capture_state.load(std::memory_order_acquire) != CAPTURE_DONE) && (std::chrono::steady_clock::now() < deadline) )
+        { thread_utils::sleepFor(std::chrono::microseconds(200)); }
+
+        int expected = CAPTURE_REQUESTED;
+        if( capture_state.compare_exchange_strong(expected, CAPTURE_IDLE) )
+        { return stack; } //the thread did not handle the signal in time (e.g. blocked it)
+        while( capture_state.load(std::memory_order_acquire) != CAPTURE_DONE ) {}
+
+        char** symbols = backtrace_symbols(capture_frames, capture_depth);
+        if( symbols )
+        {
+            //the first frames are the signal handler and the signal trampoline
+            for(int i = 2; i < capture_depth; ++i) { stack.push_back(symbols[i]); }
+            free(symbols);
+        }
+        capture_state.store(CAPTURE_IDLE);
+        return stack;
+    }
+}
+
+namespace thread_utils
+{
+
+void Heartbeat::enter()
+{
+    mTid.store(static_cast<pid_t>(syscall(SYS_gettid)), std::memory_order_relaxed);
+    mRunning.store(true, std::memory_order_relaxed);
+}
+
+Watchdog::Watchdog(const callback_t& on_stall, std::chrono::milliseconds period)
+    : mOnStall(on_stall)
+    , mPeriod(period)
+    , mCaptureStack(false)
+    , mCaptureSignal(SIGURG)
+    , mMutex()
+    , mWatched()
+    , mStalls(0)
+    , mWakeup()
+    , mMonitor(new LoopThread("watchdog"))
+{}
+
+Watchdog::~Watchdog()
+{
+    stop();
+}
+
+bool Watchdog::start()
+{
+    if( mMonitor->isRunning() ) { return false; }
+    if( mCaptureStack )
+    {
+        void* frames[1];
+        backtrace(frames, 1);//loads the unwinder, so the signal handler does not allocate
+        struct sigaction action;
+        sigemptyset(&action.sa_mask);
+        action.sa_handler = captureHandler;
+        action.sa_flags = SA_RESTART;
+        sigaction(mCaptureSignal, &action, NULL);
+    }
+    return mMonitor->start([this](const StopToken& token)
+    {
+        scan();
+        mWakeup.wait_for(static_cast<int64_t>(mPeriod.count()), token);
+        return true;
+    });
+}
+
+void Watchdog::stop()
+{
+    mMonitor->stop(true);
+}
+
+void Watchdog::setStackCapture(bool enabled, int signum)
+{
+    mCaptureStack = enabled;
+    mCaptureSignal = signum;
+}
+
+void Watchdog::watch(LoopThread& loop, std::chrono::nanoseconds budget)
+{
+    watch(loop.heartbeat(), budget);
+}
+
+void Watchdog::watch(const std::shared_ptr<Heartbeat>& heartbeat, std::chrono::nanoseconds budget)
+{
+    Watched watched = { heartbeat, budget, heartbeat->iteration(), std::chrono::steady_clock::now(), false };
+    std::lock_guard<std::mutex> guard(mMutex);
+    mWatched.push_back(watched);
+}
+
+void Watchdog::unwatch(LoopThread& loop)
+{
+    unwatch(loop.heartbeat());
+}
+
+void Watchdog::unwatch(const std::shared_ptr<Heartbeat>& heartbeat)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    mWatched.erase(std::remove_if(mWatched.begin(), mWatched.end(),
+        [&heartbeat](const Watched& watched) { return watched.heartbeat == heartbeat; }), mWatched.end());
+}
+
+void Watchdog::scan()
+{
+    std::vector<StallInfo> stalls;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        const auto now = std::chrono::steady_clock::now();
+        for(Watched& watched : mWatched)
+        {
+            const uint64_t iteration = watched.heartbeat->iteration();
+            if( !watched.heartbeat->running() || (iteration != watched.lastIteration) )
+            {
+                watched.lastIteration = iteration;
+                watched.lastProgress = now;
+                watched.reported = false;
+                continue;
+            }
+            const auto stalled = now - watched.lastProgress;
+            if( watched.reported || (stalled <= watched.budget) ) { continue; }
+
+            watched.reported = true;
+            StallInfo stall;
+            stall.name = watched.heartbeat->name();
+            stall.tid = watched.heartbeat->tid();
+            stall.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stalled);
+            stall.iteration = iteration;
+            stalls.push_back(stall);
+        }
+    }
+
+    for(StallInfo& stall : stalls)
+    {
+        THREAD_UTILS_TRACE_INSTANT("Watchdog::stall");
+        mStalls.fetch_add(1, std::memory_order_relaxed);
+        if( mCaptureStack && (stall.tid > 0) ) { stall.stack = captureStack(stall.tid, mCaptureSignal); }
+        if( mOnStall ) { mOnStall(stall); }
+    }
+}
+
+}//thread_utils end
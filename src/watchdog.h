@@ -0,0 +1,157 @@
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+
+/**
+ * C++11 required for compilation, Linux only
+ * Stall detection of loops. Every LoopThread publishes a Heartbeat: an iteration counter bumped with a relaxed store
+ * at the start of each iteration. A Watchdog scans the watched heartbeats periodically from one monitor thread and
+ * reports an iteration running longer than the budget of its loop, once per stalled iteration.
+ * The reported duration is measured from the scan that first saw the iteration, so it is accurate to one period.
+ *
+ * The budget must cover the blocking waits inside an iteration (e.g. the timeout of a pop()), an iteration blocked
+ * on an indefinite wait is reported as stalled.
+ *
+ * Example:
+ *
+ *      thread_utils::Watchdog watchdog([](const thread_utils::StallInfo& stall)
+ *      {
+ *          fprintf(stderr, "%s (%d) stalled for %lld ms\n", stall.name.c_str(), stall.tid,
+ *              static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(stall.duration).count()));
+ *          for(const auto& frame : stall.stack) { fprintf(stderr, "    %s\n", frame.c_str()); }
+ *      });
+ *      watchdog.setStackCapture(true);
+ *      watchdog.watch(consumer, std::chrono::milliseconds(500));//consumer is a LoopThread
+ *      watchdog.start();
+ */
+
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "semaphore.h"
+
+namespace thread_utils
+{
+    class LoopThread;
+    class Thread;
+
+    /**
+     * Progress of a loop, written by the loop thread only
+     */
+    class Heartbeat final
+    {
+    public:
+        explicit Heartbeat(const std::string& name) : mName(name), mIteration(0), mTid(0), mRunning(false) {}
+        /**
+         * Marks the start of an iteration
+         */
+        inline void beat() { mIteration.store(mIteration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+        /**
+         * Called on the loop thread when the loop starts
+         */
+        void enter();
+        /**
+         * Called when the loop ends, a stopped loop is not monitored
+         */
+        inline void leave() { mRunning.store(false, std::memory_order_relaxed); }
+
+        inline const std::string& name() const  { return mName; }
+        inline uint64_t iteration() const       { return mIteration.load(std::memory_order_relaxed); }
+        inline pid_t tid() const                { return mTid.load(std::memory_order_relaxed); }
+        inline bool running() const             { return mRunning.load(std::memory_order_relaxed); }
+    private:
+        const std::string       mName;
+        std::atomic<uint64_t>   mIteration;
+        std::atomic<pid_t>      mTid;
+        std::atomic_bool        mRunning;
+    };
+
+    /**
+     * Passed to the stall callback of a Watchdog
+     */
+    struct StallInfo
+    {
+        std::string                 name;       //name of the loop (thread)
+        pid_t                       tid;        //kernel thread id of the loop
+        std::chrono::nanoseconds    duration;   //time since the stalled iteration was first seen
+        uint64_t                    iteration;  //number of the stalled iteration
+        std::vector<std::string>    stack;      //symbolized frames of the stalled thread if stack capture is enabled
+    };
+
+    class Watchdog final
+    {
+    public:
+        typedef std::function<void (const StallInfo& stall)> callback_t;
+        /**
+         * @param on_stall Invoked on the monitor thread once per stalled iteration
+         * @param period Scan period, the resolution of the detection. Default value: 100 ms
+         */
+        explicit Watchdog(const callback_t& on_stall, std::chrono::milliseconds period = std::chrono::milliseconds(100));
+        Watchdog(const Watchdog&) = delete;
+        Watchdog& operator=(const Watchdog&) = delete;
+        ~Watchdog();
+        /**
+         * Starts the monitor thread
+         * @return False is returned if it is already running
+         */
+        bool start();
+        /**
+         * Stops and joins the monitor thread
+         */
+        void stop();
+        /**
+         * Captures the stack of a stalled thread by sending it the given signal. The handler is installed by start()
+         * and records the frames with backtrace(), the thread continues afterwards. The signal must not be used
+         * otherwise by the application. Must be called before start().
+         * @param enabled
+         * @param signum Default value: SIGURG (ignored by default, so a late signal is harmless)
+         */
+        void setStackCapture(bool enabled, int signum = SIGURG);
+        /**
+         * Monitors the iterations of the given loop
+         * @param loop
+         * @param budget Longest allowed iteration
+         */
+        void watch(LoopThread& loop, std::chrono::nanoseconds budget);
+        /**
+         * Monitors a custom loop publishing the given heartbeat
+         */
+        void watch(const std::shared_ptr<Heartbeat>& heartbeat, std::chrono::nanoseconds budget);
+        void unwatch(LoopThread& loop);
+        void unwatch(const std::shared_ptr<Heartbeat>& heartbeat);
+        /**
+         * Returns the number of stalls detected so far
+         */
+        inline uint64_t stalls() const { return mStalls.load(std::memory_order_relaxed); }
+    private:
+        struct Watched
+        {
+            std::shared_ptr<Heartbeat>              heartbeat;
+            std::chrono::nanoseconds                budget;
+            uint64_t                                lastIteration;
+            std::chrono::steady_clock::time_point   lastProgress;
+            bool                                    reported;
+        };
+
+        void scan();
+
+        const callback_t                    mOnStall;
+        const std::chrono::milliseconds     mPeriod;
+        bool                                mCaptureStack;
+        int                                 mCaptureSignal;
+        std::mutex                          mMutex;
+        std::vector<Watched>                mWatched;
+        std::atomic<uint64_t>               mStalls;
+        binary_semaphore_t                  mWakeup;
+        std::unique_ptr<LoopThread>         mMonitor;
+    };
+}
+
+#endif
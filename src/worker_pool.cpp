@@ -0,0 +1,187 @@
+#include "worker_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <iterator>
+
+namespace thread_utils
+{
+
+WorkerPool::WorkerPool(const std::string& name, const WorkerPoolOptions& options)
+    : mName(name)
+    , mOptions(options)
+    , mMutex()
+    , mCondition()
+    , mJobs()
+    , mWorkers()
+    , mStopping(false)
+    , mWorkerCount(0)
+    , mIdleCount(0)
+    , mStarting(0)
+    , mNextWorkerId(0)
+    , mLastGrowth()
+    , mMetrics()
+{
+    std::vector<Worker*> workers;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        const uint32_t initial = std::min(mOptions.minWorkers, mOptions.maxWorkers);
+        while( mWorkerCount < initial ) { workers.push_back(grow(Growth::Initial)); }
+    }
+    for(Worker* worker : workers) { start(worker); }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+bool WorkerPool::submit(const std::function<void ()>& job)
+{
+    return enqueue(std::function<void ()>(job));
+}
+
+bool WorkerPool::submit(std::function<void ()>&& job)
+{
+    return enqueue(std::move(job));
+}
+
+bool WorkerPool::enqueue(std::function<void ()>&& job)
+{
+    bool notify = false;
+    Worker* spawned = nullptr;
+    std::list<Worker> exited;
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if( mStopping ) { return false; }
+        mJobs.push_back(Job{std::move(job), std::chrono::steady_clock::now()});
+        takeExited(exited);
+        if( mIdleCount > 0 )
+        {
+            notify = true;
+        } else if( mWorkerCount == 0 ) {
+            spawned = grow(Growth::Initial);
+        } else if( mJobs.size() > mOptions.depthThreshold ) {
+            spawned = grow(Growth::Depth);
+        }
+    }
+    if( notify ) { mCondition.notify_one(); }
+    if( spawned ) { start(spawned); }
+    for(Worker& worker : exited) { worker.thread->join(); }
+    return true;
+}
+
+void WorkerPool::stop()
+{
+    std::list<Worker> workers;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStopping = true;
+        mCondition.notify_all();
+        //a worker being started is joined below as well
+        mCondition.wait(lock, [this]() { return mStarting == 0; });
+        workers.splice(workers.end(), mWorkers);
+    }
+    for(Worker& worker : workers) { worker.thread->join(); }
+}
+
+WorkerPoolMetrics WorkerPool::metrics() const
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    WorkerPoolMetrics metrics = mMetrics;
+    metrics.workers = mWorkerCount;
+    metrics.idleWorkers = mIdleCount;
+    metrics.queueDepth = mJobs.size();
+    return metrics;
+}
+
+WorkerPool::Worker* WorkerPool::grow(Growth reason)
+{
+    if( mStopping || (mWorkerCount >= mOptions.maxWorkers) ) { return nullptr; }
+    const auto now = std::chrono::steady_clock::now();
+    if( (reason != Growth::Initial) && (mNextWorkerId > 0) && (now - mLastGrowth < mOptions.growCooldown) ) { return nullptr; }
+
+    mWorkers.push_back(Worker{std::unique_ptr<Thread>(new Thread(mName + "-" + std::to_string(mNextWorkerId++))), reason, true, false});
+    mLastGrowth = now;
+    ++mWorkerCount;
+    ++mStarting;
+    return &mWorkers.back();
+}
+
+void WorkerPool::start(Worker* worker)
+{
+    Thread& thread = *worker->thread;
+    if( !mOptions.affinity.empty() ) { thread.setAffinity(mOptions.affinity); }
+    if( mOptions.niceValue != 0 ) { thread.setPriority(mOptions.niceValue); }
+    thread.setStack(mOptions.stack);
+    const bool started = thread.run([this, worker]() { work(worker); });
+
+    std::lock_guard<std::mutex> guard(mMutex);
+    if( started )
+    {
+        ++mMetrics.spawned;
+        mMetrics.peakWorkers = std::max(mMetrics.peakWorkers, mWorkerCount);
+        if( worker->growth == Growth::Depth )   { ++mMetrics.growthsByDepth; }
+        if( worker->growth == Growth::Sojourn ) { ++mMetrics.growthsBySojourn; }
+        THREAD_UTILS_TRACE_COUNTER("WorkerPool::workers", static_cast<int64_t>(mWorkerCount));
+    } else {
+        //never ran, reaped like a retired worker
+        --mWorkerCount;
+        worker->exited = true;
+    }
+    worker->starting = false;
+    if( (--mStarting == 0) && mStopping ) { mCondition.notify_all(); }
+}
+
+void WorkerPool::takeExited(std::list<Worker>& exited)
+{
+    for(auto it = mWorkers.begin(); it != mWorkers.end(); )
+    {
+        auto next = std::next(it);
+        if( it->exited && !it->starting ) { exited.splice(exited.end(), mWorkers, it); }
+        it = next;
+    }
+}
+
+void WorkerPool::work(Worker* worker)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while( true )
+    {
+        if( !mJobs.empty() )
+        {
+            Job job = std::move(mJobs.front());
+            mJobs.pop_front();
+            const std::chrono::nanoseconds sojourn = std::chrono::steady_clock::now() - job.enqueued;
+            mMetrics.maxSojourn = std::max(mMetrics.maxSojourn, sojourn);
+            Worker* spawned = nullptr;
+            if( (sojourn > mOptions.sojournThreshold) && (mIdleCount == 0) && !mJobs.empty() ) { spawned = grow(Growth::Sojourn); }
+            lock.unlock();
+            if( spawned ) { start(spawned); }
+            job.function();
+            job.function = nullptr;//captured state is released outside of the lock as well
+            lock.lock();
+            ++mMetrics.executed;
+            continue;
+        }
+        if( mStopping ) { break; }
+
+        ++mIdleCount;
+        const bool woken = mCondition.wait_for(lock, mOptions.linger, [this]() { return !mJobs.empty() || mStopping; });
+        --mIdleCount;
+        if( !woken && (mWorkerCount > mOptions.minWorkers) )
+        {
+            ++mMetrics.retired;
+            break;
+        }
+    }
+    //the workers retired before are joined here, this one by the next retiring worker, submit() or stop()
+    std::list<Worker> exited;
+    takeExited(exited);
+    --mWorkerCount;
+    worker->exited = true;
+    THREAD_UTILS_TRACE_COUNTER("WorkerPool::workers", static_cast<int64_t>(mWorkerCount));
+    lock.unlock();
+    for(Worker& retired : exited) { retired.thread->join(); }
+}
+
+}//thread_utils end
@@ -0,0 +1,173 @@
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+/**
+ * C++11 required for compilation
+ * Elastic pool of worker Threads executing submitted jobs in FIFO order.
+ *
+ * The pool grows by one worker when no worker is idle and either the queue is deeper than the depth threshold
+ * (checked on submit) or a job waited longer than the sojourn threshold (checked when a job is taken). Two growths are
+ * at least the grow cooldown apart, so a burst does not spawn a thread per job. A worker idle for the linger period
+ * retires while the pool is above its minimum size. Growing fast and shrinking only after a long idle period is the
+ * hysteresis keeping the pool from thrashing. Retired workers are joined, and their stacks released, by the next
+ * retiring worker or the next submit. Workers are started and joined outside of the lock of the queue.
+ *
+ * Example:
+ *
+ *      thread_utils::WorkerPoolOptions options;
+ *      options.minWorkers = 2;
+ *      options.maxWorkers = 16;
+ *      options.affinity = {2, 3, 4, 5};
+ *      thread_utils::WorkerPool pool("decoder", options);
+ *      pool.submit([frame]() { decode(frame); });
+ *      ...
+ *      auto metrics = pool.metrics();
+ *      printf("workers: %u (peak %u)\n", metrics.workers, metrics.peakWorkers);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "thread.h"
+
+namespace thread_utils
+{
+    struct WorkerPoolOptions
+    {
+        uint32_t                    minWorkers = 1;
+        uint32_t                    maxWorkers = 8;
+        /**
+         * Grow if more jobs than this are queued on submit while no worker is idle
+         */
+        size_t                      depthThreshold = 4;
+        /**
+         * Grow if a job waited longer than this in the queue while no worker is idle
+         */
+        std::chrono::microseconds   sojournThreshold = std::chrono::microseconds(1000);
+        /**
+         * Idle time after which a worker above the minimum retires
+         */
+        std::chrono::milliseconds   linger = std::chrono::milliseconds(1000);
+        /**
+         * Minimum time between two growths
+         */
+        std::chrono::milliseconds   growCooldown = std::chrono::milliseconds(5);
+        /**
+         * Applied to every new worker, see Thread::setAffinity(), Thread::setPriority() and Thread::setStack()
+         */
+        std::vector<int32_t>        affinity;
+        int32_t                     niceValue = 0;
+        StackOptions                stack;
+    };
+
+    /**
+     * Scaling decisions and load of a WorkerPool, see WorkerPool::metrics()
+     */
+    struct WorkerPoolMetrics
+    {
+        uint32_t                    workers;            //current number of workers
+        uint32_t                    idleWorkers;        //workers waiting for a job
+        uint32_t                    peakWorkers;        //highest number of workers so far
+        size_t                      queueDepth;         //jobs waiting
+        uint64_t                    executed;           //jobs finished
+        uint64_t                    spawned;            //workers started, including the minimum
+        uint64_t                    retired;            //workers retired after lingering
+        uint64_t                    growthsByDepth;     //growths triggered by the depth threshold
+        uint64_t                    growthsBySojourn;   //growths triggered by the sojourn threshold
+        std::chrono::nanoseconds    maxSojourn;         //longest time a job waited in the queue
+    };
+
+    class WorkerPool final
+    {
+    public:
+        /**
+         * Starts the minimum number of workers
+         * @param name Prefix of the names of the worker threads
+         * @param options
+         */
+        WorkerPool(const std::string& name, const WorkerPoolOptions& options = WorkerPoolOptions());
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+        /**
+         * Stops the pool, see stop()
+         */
+        ~WorkerPool();
+        /**
+         * Queues a job for execution. Jobs must not throw.
+         * @return False is returned if the pool is stopped
+         */
+        bool submit(const std::function<void ()>& job);
+        /**
+         * Queues a job for execution. Jobs must not throw.
+         * @return False is returned if the pool is stopped
+         */
+        bool submit(std::function<void ()>&& job);
+        /**
+         * Stops accepting jobs, lets the workers finish the queued ones and joins them.
+         * Must not be called from a worker.
+         */
+        void stop();
+        /**
+         * Returns a snapshot of the metrics
+         */
+        WorkerPoolMetrics metrics() const;
+    private:
+        struct Job
+        {
+            std::function<void ()>                  function;
+            std::chrono::steady_clock::time_point   enqueued;
+        };
+
+        enum class Growth { Initial, Depth, Sojourn };
+
+        struct Worker
+        {
+            std::unique_ptr<Thread> thread;
+            Growth                  growth;
+            bool                    starting;//start() has not finished with it yet
+            bool                    exited;
+        };
+
+        bool enqueue(std::function<void ()>&& job);
+        /**
+         * Reserves a worker if the bounds and the cooldown allow it, nullptr otherwise. Called with mMutex held, the
+         * worker is started by start() after the lock is released.
+         */
+        Worker* grow(Growth reason);
+        /**
+         * Runs the thread of a reserved worker. Called without mMutex held.
+         */
+        void start(Worker* worker);
+        /**
+         * Moves the workers that left work() to @p exited, they are joined after the lock is released.
+         * Called with mMutex held.
+         */
+        void takeExited(std::list<Worker>& exited);
+        void work(Worker* worker);
+
+        const std::string           mName;
+        const WorkerPoolOptions     mOptions;
+        mutable std::mutex          mMutex;
+        std::condition_variable     mCondition;
+        std::deque<Job>             mJobs;
+        std::list<Worker>           mWorkers;
+        bool                        mStopping;
+        uint32_t                    mWorkerCount;
+        uint32_t                    mIdleCount;
+        uint32_t                    mStarting;//reserved workers not started yet
+        uint64_t                    mNextWorkerId;
+        std::chrono::steady_clock::time_point mLastGrowth;
+        WorkerPoolMetrics           mMetrics;
+    };
+}
+
+#endif
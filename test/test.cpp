@@ -1,7 +1,40 @@
 #include <stdio.h>
 #include "test_run.h"
+#include "test_coroutine.h"
+#include "test_stop.h"
+#include "test_semaphore.h"
+#include "test_barrier.h"
+#include "test_active_object.h"
+#include "test_timing.h"
+#include "test_watchdog.h"
+#include "test_thread_local.h"
+#include "test_stack.h"
+#include "test_queue.h"
+#include "test_worker_pool.h"
+#include "test_shared_mutex.h"
+#include "test_profiler.h"
+#include "test_trace.h"
+#include "test_allocator.h"
+#include "test_sharded_queue.h"
 
 int main(int argc, char** argv)
 {
-    return thread_utils::tests::test_run() ? 0 : 1;
-}
\ No newline at end of file
+    bool success = thread_utils::tests::test_run();
+    success = thread_utils::tests::test_coroutine() && success;
+    success = thread_utils::tests::test_stop() && success;
+    success = thread_utils::tests::test_semaphore() && success;
+    success = thread_utils::tests::test_barrier() && success;
+    success = thread_utils::tests::test_active_object() && success;
+    success = thread_utils::tests::test_timing() && success;
+    success = thread_utils::tests::test_watchdog() && success;
+    success = thread_utils::tests::test_thread_local() && success;
+    success = thread_utils::tests::test_stack() && success;
+    success = thread_utils::tests::test_queue() && success;
+    success = thread_utils::tests::test_worker_pool() && success;
+    success = thread_utils::tests::test_shared_mutex() && success;
+    success = thread_utils::tests::test_profiler() && success;
+    success = thread_utils::tests::test_trace() && success;
+    success = thread_utils::tests::test_allocator() && success;
+    success = thread_utils::tests::test_sharded_queue() && success;
+    return success ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include "active_object.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <future>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Are messages and calls handled in the order they were posted?
+         * 2. Does the batch handler receive every message exactly once?
+         * 3. Are the pending messages handled on stop with the Drain policy?
+         * 4. Are the pending messages dropped and the futures of pending calls broken with the Discard policy?
+         */
+        bool test_active_object()
+        {
+            const uint64_t message_count = 10000;
+            //messages are recorded by value, calls by 0
+            std::vector<uint64_t> handled_order;
+            std::vector<uint64_t> posted_order;
+            ActiveObject<uint64_t> recorder("test_active0");
+            recorder.start([&handled_order](uint64_t& value) { handled_order.push_back(value); });
+            std::future<size_t> result;
+            for(uint64_t i = 1; i <= message_count; ++i)
+            {
+                recorder.post(i);
+                posted_order.push_back(i);
+                if( i % 1000 == 0 )
+                {
+                    result = recorder.call([&handled_order]() { handled_order.push_back(0); return handled_order.size(); });
+                    posted_order.push_back(0);
+                }
+            }
+            if( (result.get() != posted_order.size()) || (handled_order != posted_order) ) { return false; }
+
+            uint64_t batched_sum = 0;
+            uint64_t handled = 0;
+            ActiveObject<uint64_t> batcher("test_active1");
+            for(uint64_t i = 1; i <= message_count; ++i) { batcher.post(i); }
+            batcher.start([&batched_sum, &handled](std::vector<uint64_t>& values)
+            {
+                for(uint64_t value : values) { batched_sum += value; }
+                handled += values.size();
+            });
+            batcher.stop();
+            if( (handled != message_count) || (batched_sum != message_count * (message_count + 1) / 2) || batcher.post(1) ) { return false; }
+
+            std::vector<int> discarded_handled;
+            std::atomic_bool entered(false);
+            std::atomic_bool release(false);
+            ActiveObject<int> discarder("test_active2", ActiveObjectShutdown::Discard);
+            discarder.start([&](int& value)
+            {
+                discarded_handled.push_back(value);
+                entered.store(true);
+                while( !release.load() ) { sleepFor(1); }
+            });
+            discarder.post(1);
+            while( !entered.load() ) { sleepFor(1); }
+            //queued behind the blocked handler
+            discarder.post(2);
+            std::future<int> pending_call = discarder.call([]() { return 3; });
+            Thread releaser("test_active3");
+            releaser.run([&discarder, &release]()
+            {
+                while( discarder.post(4) ) { sleepFor(1); }//refused once stop() has begun
+                release.store(true);
+            });
+            discarder.stop();
+            releaser.join();
+            if( (discarded_handled.size() != 1) || (discarded_handled.front() != 1) ) { return false; }
+            try
+            {
+                pending_call.get();
+            } catch(const std::future_error& error) {
+                return error.code() == std::future_errc::broken_promise;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include "blocking_queue.h"
+#include "pool_allocator.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory_resource>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Memory resource counting the allocations forwarded to the default resource
+         */
+        class CountingResource final : public std::pmr::memory_resource
+        {
+        public:
+            std::atomic<uint64_t> allocations{0};
+        private:
+            void* do_allocate(size_t bytes, size_t alignment) override
+            {
+                allocations.fetch_add(1);
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+            void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+            { std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment); }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+        };
+
+        /**
+         * Pushes and pops the given number of elements a hundred times
+         */
+        template<typename Queue>
+        bool cycle(Queue& queue, uint64_t count)
+        {
+            for(int round = 0; round < 100; ++round)
+            {
+                for(uint64_t i = 0; i < count; ++i) { queue.push(i); }
+                for(uint64_t i = 0; i < count; ++i)
+                {
+                    if( queue.pop(0) != i ) { return false; }
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Tests:
+         * 1. Does pmr::BlockingQueue allocate from its memory resource, and does a pool resource stop asking the
+         *    upstream resource for memory after warm-up?
+         * 2. Does PooledBlockingQueue stop taking blocks from operator new after warm-up?
+         */
+        bool test_allocator()
+        {
+            const uint64_t element_count = 1000;
+            CountingResource upstream;
+            std::pmr::synchronized_pool_resource pool(&upstream);
+            {
+                pmr::BlockingQueue<uint64_t> queue(&pool);
+                if( !cycle(queue, element_count) || (upstream.allocations.load() == 0) ) { return false; }
+                const uint64_t warmed_up = upstream.allocations.load();
+                if( !cycle(queue, element_count) || (upstream.allocations.load() != warmed_up) ) { return false; }
+            }
+
+            PooledBlockingQueue<uint64_t> pooled;
+            if( !cycle(pooled, element_count) ) { return false; }
+            const uint64_t warmed_up = detail::NodePool::systemAllocations();
+            return (warmed_up > 0) && cycle(pooled, element_count) && (detail::NodePool::systemAllocations() == warmed_up);
+        }
+    }
+}
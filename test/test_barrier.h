@@ -0,0 +1,82 @@
+#include "barrier.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does Barrier release every party only after the completion function of the phase has run?
+         * 2. Does Latch release its waiters once counted down?
+         * 3. Does Phaser advance with a party deregistering and another registering?
+         * 4. Does a party registering while other parties advance the phases get the phase it belongs to?
+         */
+        bool test_barrier()
+        {
+            const uint32_t party_count = 4;
+            const uint32_t phase_count = 1000;
+            std::atomic_uint32_t completed_phases(0);
+            std::atomic_bool in_order(true);
+            Barrier barrier(party_count, [&completed_phases]() { ++completed_phases; });
+            Latch finished(party_count);
+
+            std::vector<std::unique_ptr<Thread>> threads;
+            for(uint32_t i = 0; i < party_count; ++i)
+            {
+                threads.emplace_back(new Thread("test_barrier"));
+                threads.back()->run([&]()
+                {
+                    for(uint32_t phase = 1; phase <= phase_count; ++phase)
+                    {
+                        barrier.arrive_and_wait();
+                        if( completed_phases.load() < phase ) { in_order.store(false); }
+                    }
+                    finished.count_down();
+                });
+            }
+            finished.wait();
+            for(auto& thread : threads) { thread->join(); }
+            if( !in_order.load() || (completed_phases.load() != phase_count) ) { return false; }
+
+            Phaser phaser(2);
+            uint32_t phase = phaser.arrive();
+            phaser.arrive_and_deregister();
+            phaser.await_advance(phase);
+            phaser.register_party();
+            phase = phaser.arrive();
+            if( (phaser.phase() != 1) || (phase != 1) || (phaser.registered_parties() != 2) ) { return false; }
+
+            Phaser busy(2);
+            std::atomic_bool consistent(true);
+            threads.clear();
+            for(uint32_t i = 0; i < 2; ++i)
+            {
+                threads.emplace_back(new Thread("test_phaser"));
+                threads.back()->run([&busy]()
+                {
+                    for(uint32_t j = 0; j < phase_count * 10; ++j) { busy.arrive_and_await_advance(); }
+                    busy.arrive_and_deregister();
+                });
+            }
+            while( busy.registered_parties() > 0 )
+            {
+                const uint32_t registered = busy.register_party();
+                //the phase can not advance before the new party arrives
+                if( busy.phase() != registered ) { consistent.store(false); }
+                const uint32_t arrived = busy.arrive();
+                busy.await_advance(arrived);
+                if( (arrived != registered) || (busy.phase() == arrived) ) { consistent.store(false); }
+                busy.arrive_and_deregister();
+                if( busy.registered_parties() == 0 ) { break; }
+            }
+            for(auto& thread : threads) { thread->join(); }
+            return consistent.load();
+        }
+    }
+}
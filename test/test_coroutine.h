@@ -0,0 +1,62 @@
+#include "coroutine.h"
+#include "blocking_queue.h"
+#include "semaphore.h"
+
+#include <stdint.h>
+#include <atomic>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Are coroutines suspended on BlockingQueue::async_pop(), BlockingSlot::async_get() and
+         * Semaphore::async_acquire() resumed by push(), set() and post()?
+         * 2. Does asyncSleepFor() resume the coroutine on the scheduler?
+         */
+        bool test_coroutine()
+        {
+            const uint32_t consumer_count = 1000;
+            BlockingQueue<uint32_t> queue;
+            BlockingSlot<uint32_t> slot;
+            semaphore_t permits;
+            semaphore_t finished;
+            std::atomic_uint32_t sum(0);
+
+            auto consumer = [&]() -> Task
+            {
+                uint32_t value = co_await queue.async_pop();
+                co_await permits.async_acquire();
+                co_await asyncSleepFor(10);
+                sum += value;
+                finished.post();
+            };
+            auto slot_reader = [&]() -> Task
+            {
+                auto value = co_await slot.async_get();
+                sum += value.value_or(0);
+                finished.post();
+            };
+
+            Scheduler scheduler("test_sched", 2);
+            for(uint32_t i = 0; i < consumer_count; ++i) { scheduler.spawn(consumer()); }
+            scheduler.spawn(slot_reader());
+            scheduler.start();
+
+            for(uint32_t i = 1; i <= consumer_count; ++i)
+            {
+                queue.push(i);
+                permits.post();
+            }
+            slot.set(7);
+
+            for(uint32_t i = 0; i <= consumer_count; ++i)
+            {
+                if( !finished.wait_for(5000) ) { return false; }
+            }
+            scheduler.stop(true);
+            return (sum.load() == (consumer_count * (consumer_count + 1) / 2 + 7));
+        }
+    }
+}
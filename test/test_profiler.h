@@ -0,0 +1,84 @@
+#include "profiled_mutex.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests (profiling is compiled in by 'make instrumented'):
+         * 1. Are the acquisitions and the contended acquisitions of a ProfiledMutex counted?
+         * 2. Do the wait histogram percentiles cover the time a contender was blocked?
+         * 3. Are the call sites ordered by contention, the most contended first?
+         * 4. Is the call site of every Nth contention recorded only, weighted by N?
+         */
+        bool test_profiler()
+        {
+#ifdef THREAD_UTILS_LOCK_PROFILING
+            //locks the mutex, so a contender is blocked in locker() for a few milliseconds
+            auto contend = [](ProfiledMutex& mutex, const std::function<void ()>& locker)
+            {
+                std::atomic_bool blocked(false);
+                mutex.lock();
+                Thread contender("test_profiler");
+                contender.run([&mutex, &blocked, &locker]()
+                {
+                    blocked.store(true);
+                    locker();
+                    mutex.unlock();
+                });
+                while( !blocked.load() ) { sleepFor(1); }
+                sleepFor(5);//the contender is blocked on the mutex
+                mutex.unlock();
+                contender.join();
+            };
+
+            LockProfiler::setSampleRate(1);
+            LockProfile& profile = LockProfiler::profile("test_profiler");
+            profile.reset();
+            {
+                ProfiledMutex mutex("test_profiler");
+                uint32_t weight = 0;
+                //two distinct call sites of lock()
+                auto lock_once = [&mutex, &weight]() { mutex.lock(); weight += 1; };
+                auto lock_thrice = [&mutex, &weight]() { mutex.lock(); weight += 3; };
+                contend(mutex, lock_once);
+                contend(mutex, lock_thrice);
+                contend(mutex, lock_thrice);
+                contend(mutex, lock_thrice);
+                if( weight != 10 ) { return false; }
+            }
+            if( (profile.acquisitions() != 8) || (profile.contended() != 4) ) { return false; }
+            if( (profile.contentionRatio() != 0.5) || (profile.waitPercentile(0.5) < 1000000) ) { return false; }
+            if( profile.holdPercentile(0.99) < 1000000 ) { return false; }
+
+            auto call_sites = profile.topCallSites();
+            if( (call_sites.size() != 2) || (call_sites[0].second != 3) || (call_sites[1].second != 1) ) { return false; }
+
+            //every 2nd contention records its call site, standing for both
+            LockProfiler::setSampleRate(2);
+            profile.reset();
+            {
+                ProfiledMutex mutex("test_profiler");
+                auto lock = [&mutex]() { mutex.lock(); };
+                contend(mutex, lock);
+                if( !profile.topCallSites().empty() ) { return false; }
+                contend(mutex, lock);
+            }
+            LockProfiler::setSampleRate(64);
+            call_sites = profile.topCallSites();
+            return (profile.contended() == 2) && (call_sites.size() == 1) && (call_sites[0].second == 2);
+#else
+            ProfiledMutex mutex("test_profiler");
+            if( !mutex.try_lock() ) { return false; }
+            const bool exclusive = !mutex.try_lock();
+            mutex.unlock();
+            return exclusive;
+#endif
+        }
+    }
+}
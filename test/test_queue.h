@@ -0,0 +1,51 @@
+#include "blocking_queue.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Can move-only elements be pushed, emplaced and popped across threads?
+         * 2. Do emplace_front() and emplace_back() construct in place at the right end?
+         * 3. Does pop_into() move into the given storage and leave it untouched on timeout?
+         */
+        bool test_queue()
+        {
+            const int element_count = 1000;
+            BlockingQueue<std::unique_ptr<int>> pointers;
+            Thread producer("test_queue");
+            producer.run([&pointers, element_count]()
+            {
+                for(int i = 0; i < element_count; ++i)
+                {
+                    if( i % 2 ) { pointers.push(std::make_unique<int>(i)); }
+                    else        { pointers.emplace_back(new int(i)); }
+                }
+            });
+            int64_t sum = 0;
+            std::unique_ptr<int> element;
+            for(int i = 0; i < element_count; ++i)
+            {
+                if( !pointers.pop_into(element, 1000) || !element || (*element != i) ) { return false; }
+                sum += *element;
+            }
+            producer.join();
+            if( (sum != int64_t(element_count) * (element_count - 1) / 2) || pointers.pop_into(element, 10) || (*element != element_count - 1) )
+            { return false; }
+
+            BlockingQueue<std::pair<std::string, int>> pairs;
+            pairs.emplace_back("second", 2);
+            pairs.emplace_front("first", 1);
+            auto first = pairs.pop();
+            auto second = pairs.pop();
+            return (first->first == "first") && (first->second == 1) && (second->first == "second") && (second->second == 2);
+        }
+    }
+}
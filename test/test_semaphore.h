@@ -0,0 +1,116 @@
+#include "semaphore.h"
+#include "posix_semaphore.h"
+#include "thread.h"
+#include "coroutine.h"
+
+#include <stdint.h>
+#include <atomic>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Are multi-unit post(n), try_wait(n) and wait_for(n, timeout) all or nothing?
+         * 2. Does FIFO-fair mode serve a large wait(n) before later small requests?
+         * 3. Does post() hand units only to a waiter it can satisfy, skipping a larger request in the default mode?
+         * 4. Are suspended coroutines queued behind waiting threads in FIFO-fair mode?
+         * 5. Does a timed multi-unit wait of PosixSemaphore take nothing on timeout and include the time queued behind
+         *    another waiter?
+         */
+        bool test_semaphore()
+        {
+            semaphore_t semaphore;
+            semaphore.set_limit(10);
+            if( !semaphore.post(6) || semaphore.post(5) || (semaphore.value() != 6) ) { return false; }
+            if( semaphore.try_wait(7) || !semaphore.try_wait(4) || (semaphore.value() != 2) ) { return false; }
+            if( semaphore.wait_for(3, 50) || (semaphore.value() != 2) ) { return false; }
+            semaphore.wait(2);
+
+            semaphore_t fair;
+            fair.set_fair(true);
+            std::atomic_bool large_done(false);
+            std::atomic_bool small_done(false);
+            Thread large("test_sem0");
+            large.run([&fair, &large_done]()
+            {
+                fair.wait(4);
+                large_done.store(true);
+            });
+            sleepFor(50);
+            Thread small("test_sem1");
+            small.run([&fair, &small_done]()
+            {
+                fair.wait();
+                small_done.store(true);
+            });
+            sleepFor(50);
+            //the four units go to the large request, none of them to the small one queued behind it
+            for(uint32_t i = 0; i < 4; ++i) { fair.post(); }
+            for(int i = 0; (i < 100) && !large_done.load(); ++i) { sleepFor(5); }
+            const bool served_in_order = large_done.load() && !small_done.load() && (fair.value() == 0);
+            fair.post(served_in_order ? 1 : 2);
+            large.join();
+            small.join();
+            if( !served_in_order ) { return false; }
+
+            semaphore_t barging;
+            std::atomic_bool three_taken(false);
+            std::atomic_bool one_taken(false);
+            Thread three("test_sem2");
+            three.run([&barging, &three_taken]() { barging.wait(3); three_taken.store(true); });
+            sleepFor(20);
+            Thread one("test_sem3");
+            one.run([&barging, &one_taken]() { barging.wait(1); one_taken.store(true); });
+            sleepFor(20);
+            barging.post(1);
+            one.join();
+            sleepFor(20);
+            if( !one_taken.load() || three_taken.load() || (barging.value() != 0) ) { return false; }
+            barging.post(3);
+            three.join();
+            if( !three_taken.load() ) { return false; }
+#ifdef THREAD_UTILS_HAS_COROUTINES
+            semaphore_t ordered;
+            ordered.set_fair(true);
+            std::atomic_bool thread_done(false);
+            std::atomic_bool coroutine_done(false);
+            Thread waiter("test_sem4");
+            waiter.run([&ordered, &thread_done]() { ordered.wait(2); thread_done.store(true); });
+            sleepFor(20);
+            auto acquirer = [&ordered, &coroutine_done]() -> Task
+            {
+                co_await ordered.async_acquire();
+                coroutine_done.store(true);
+            };
+            Scheduler scheduler("test_sem_sched", 1);
+            scheduler.spawn(acquirer());
+            scheduler.start();
+            sleepFor(20);
+            ordered.post(1);
+            sleepFor(20);
+            if( coroutine_done.load() || thread_done.load() ) { return false; }
+            ordered.post(1);
+            waiter.join();
+            ordered.post(1);
+            for(int i = 0; (i < 100) && !coroutine_done.load(); ++i) { sleepFor(5); }
+            scheduler.stop(true);
+            if( !thread_done.load() || !coroutine_done.load() ) { return false; }
+#endif
+
+            PosixSemaphore posix;
+            posix.post(2);
+            if( posix.wait_for(3, 20) || (posix.value() != 2) || !posix.try_wait(2) ) { return false; }
+            Thread blocker("test_sem5");
+            blocker.run([&posix]() { posix.wait(5); });
+            sleepFor(20);
+            const auto begin = std::chrono::steady_clock::now();
+            const bool taken = posix.wait_for(1, 30);
+            const auto waited = std::chrono::steady_clock::now() - begin;
+            posix.post(5);
+            blocker.join();
+            return !taken && (waited < std::chrono::milliseconds(500)) && (posix.value() == 0);
+        }
+    }
+}
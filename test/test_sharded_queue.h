@@ -0,0 +1,75 @@
+#include "sharded_queue.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does every element of several producers reach exactly one of several consumers?
+         * 2. Does a consumer steal the elements pushed into the shard of another thread?
+         * 3. Do pop with timeout and pop with a stopped token return std::nullopt on an empty queue?
+         */
+        bool test_sharded_queue()
+        {
+            const uint32_t producer_count = 4;
+            const uint32_t consumer_count = 3;
+            const uint64_t element_count = 20000;
+            ShardedBlockingQueue<uint64_t> queue(4, ShardSelection::Thread);
+            std::atomic<uint64_t> sum(0);
+            std::atomic<uint64_t> popped(0);
+            std::vector<std::unique_ptr<Thread>> consumers;
+            for(uint32_t i = 0; i < consumer_count; ++i)
+            {
+                consumers.emplace_back(new Thread("test_sharded_c"));
+                consumers.back()->run([&]()
+                {
+                    while( auto element = queue.pop() )
+                    {
+                        if( *element == 0 ) { return; }
+                        sum.fetch_add(*element);
+                        popped.fetch_add(1);
+                    }
+                });
+            }
+            std::vector<std::unique_ptr<Thread>> producers;
+            for(uint32_t i = 0; i < producer_count; ++i)
+            {
+                producers.emplace_back(new Thread("test_sharded_p"));
+                producers.back()->run([&queue]()
+                {
+                    for(uint64_t value = 1; value <= element_count; ++value) { queue.push(value); }
+                });
+            }
+            for(auto& producer : producers) { producer->join(); }
+            for(uint32_t i = 0; i < consumer_count; ++i) { queue.push(0); }
+            for(auto& consumer : consumers) { consumer->join(); }
+            if( (popped.load() != producer_count * element_count) ||
+                (sum.load() != producer_count * element_count * (element_count + 1) / 2) ) { return false; }
+
+            //pushed into the shard of another thread, the main thread has to steal them
+            Thread producer("test_sharded_p");
+            producer.run([&queue]() { for(uint64_t value = 1; value <= 3; ++value) { queue.push(value); } });
+            producer.join();
+            if( queue.size() != 3 ) { return false; }
+            for(uint64_t value = 1; value <= 3; ++value)
+            {
+                if( queue.pop(100) != value ) { return false; }
+            }
+
+            if( queue.try_pop() || queue.pop(5) ) { return false; }
+            StopSource source;
+            Thread stopper("test_sharded_s");
+            stopper.run([&source]() { sleepFor(10); source.request_stop(); });
+            const bool stopped = !queue.pop(source.get_token());
+            stopper.join();
+            return stopped && (queue.size() == 0);
+        }
+    }
+}
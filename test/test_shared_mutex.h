@@ -0,0 +1,130 @@
+#include "shared_mutex.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Do readers of ShardedSharedMutex never see a half written update while writers run concurrently?
+         * 2. Does AdaptiveMutex serialize concurrent increments?
+         * 3. Do wait() and notify_one() hand over a value, does wait_for() time out and wait(token) return on stop?
+         * 4. Does the same hold for ShardedSharedMutex, with a reader getting the lock while the writer waits?
+         */
+        bool test_shared_mutex()
+        {
+            const uint32_t thread_count = 4;
+            const uint32_t iteration_count = 20000;
+            ShardedSharedMutex shared_mutex(3);
+            uint64_t first = 0;
+            uint64_t second = 0;
+            std::atomic_bool consistent(true);
+            std::vector<std::unique_ptr<Thread>> threads;
+            for(uint32_t i = 0; i < thread_count; ++i)
+            {
+                threads.emplace_back(new Thread("test_rwlock"));
+                threads.back()->run([&, i]()
+                {
+                    for(uint32_t j = 0; j < iteration_count; ++j)
+                    {
+                        if( (i == 0) && (j % 16 == 0) )
+                        {
+                            std::lock_guard<ShardedSharedMutex> guard(shared_mutex);
+                            ++first;
+                            ++second;
+                        } else {
+                            shared_mutex.lock_shared();
+                            if( first != second ) { consistent.store(false); }
+                            shared_mutex.unlock_shared();
+                        }
+                    }
+                });
+            }
+            for(auto& thread : threads) { thread->join(); }
+            if( !consistent.load() || (first != (iteration_count + 15) / 16) ) { return false; }
+            if( !shared_mutex.try_lock() || shared_mutex.try_lock_shared() ) { return false; }
+            shared_mutex.unlock();
+
+            AdaptiveMutex mutex;
+            uint64_t counter = 0;
+            threads.clear();
+            for(uint32_t i = 0; i < thread_count; ++i)
+            {
+                threads.emplace_back(new Thread("test_adaptive"));
+                threads.back()->run([&]()
+                {
+                    for(uint32_t j = 0; j < iteration_count; ++j)
+                    {
+                        std::lock_guard<AdaptiveMutex> guard(mutex);
+                        ++counter;
+                    }
+                });
+            }
+            for(auto& thread : threads) { thread->join(); }
+            if( counter != thread_count * iteration_count ) { return false; }
+
+            bool ready = false;
+            Thread notifier("test_notify");
+            notifier.run([&]()
+            {
+                sleepFor(10);
+                std::lock_guard<AdaptiveMutex> guard(mutex);
+                ready = true;
+                mutex.notify_one();
+            });
+            mutex.lock();
+            while( !ready ) { mutex.wait(); }
+            const bool timed_out = !mutex.wait_for(5);
+            StopSource source;
+            Thread stopper("test_stopper");
+            stopper.run([&source]() { sleepFor(10); source.request_stop(); });
+            const bool stopped = !mutex.wait(source.get_token());
+            mutex.unlock();
+            notifier.join();
+            stopper.join();
+            if( !timed_out || !stopped ) { return false; }
+
+            //the reader gets in only while the waiter has released the exclusive lock
+            bool sharded_ready = false;
+            std::atomic_bool reading(true);
+            std::atomic<uint64_t> reads(0);
+            Thread reader("test_sharded_reader");
+            Thread sharded_notifier("test_sharded_notify");
+            shared_mutex.lock();
+            reader.run([&]()
+            {
+                while( reading.load() )
+                {
+                    shared_mutex.lock_shared();
+                    if( !sharded_ready ) { reads.fetch_add(1); }
+                    shared_mutex.unlock_shared();
+                }
+            });
+            sharded_notifier.run([&]()
+            {
+                while( reads.load() == 0 ) { sleepFor(1); }
+                std::lock_guard<ShardedSharedMutex> guard(shared_mutex);
+                sharded_ready = true;
+                shared_mutex.notify_one();
+            });
+            while( !sharded_ready ) { shared_mutex.wait(); }
+            const bool sharded_timed_out = !shared_mutex.wait_for(5);
+            StopSource sharded_source;
+            stopper.run([&sharded_source]() { sleepFor(10); sharded_source.request_stop(); });
+            const bool sharded_stopped = !shared_mutex.wait(sharded_source.get_token());
+            shared_mutex.unlock();
+            reading.store(false);
+            reader.join();
+            sharded_notifier.join();
+            stopper.join();
+            return sharded_timed_out && sharded_stopped && (reads.load() > 0);
+        }
+    }
+}
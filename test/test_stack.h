@@ -0,0 +1,101 @@
+#include "thread.h"
+#include "stack_pool.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <vector>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        struct CountingStackAllocator final : public StackAllocator
+        {
+            explicit CountingStackAllocator(StackAllocator& allocator) : target(allocator), deallocations(0) {}
+            void* allocate(size_t size) override { return target.allocate(size); }
+            void deallocate(void* stack, size_t size) override { deallocations.fetch_add(1); target.deallocate(stack, size); }
+            size_t stackSize() const override { return target.stackSize(); }
+
+            StackAllocator&     target;
+            std::atomic<int>    deallocations;
+        };
+
+        /**
+         * Tests:
+         * 1. Does a Thread run on a stack of the configured size and keep the setting for the next run?
+         * 2. Does a Thread run on a stack of a StackPool, prefaulted, and is the stack handed back on join?
+         * 3. Does run() fail if the stack of the allocator is too small to be used?
+         * 4. Is the stack of a detached thread handed back after it finished?
+         */
+        bool test_stack()
+        {
+            const size_t stack_size = 128 * 1024;
+            std::atomic<size_t> observed_size(0);
+            std::atomic<void*> observed_address(nullptr);
+            std::atomic_bool resident(false);
+            auto inspect = [&observed_size, &observed_address, &resident]()
+            {
+                pthread_attr_t attr;
+                void* address = nullptr;
+                size_t size = 0;
+                pthread_getattr_np(pthread_self(), &attr);
+                pthread_attr_getstack(&attr, &address, &size);
+                pthread_attr_destroy(&attr);
+                observed_size.store(size);
+                observed_address.store(address);
+                std::vector<unsigned char> pages(size / static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+                resident.store( (mincore(address, size, pages.data()) == 0) && (pages.front() & 1) );
+            };
+
+            Thread thread("test_stack");
+            StackOptions options;
+            options.size = stack_size;
+            if( !thread.setStack(options) ) { return false; }
+            for(int run = 0; run < 2; ++run)
+            {
+                thread.run(inspect);
+                thread.join();
+                if( observed_size.load() < stack_size || observed_size.load() > 2 * stack_size ) { return false; }
+            }
+
+            StackPool pool(stack_size, 4096, false, true);
+            options.size = 0;
+            options.allocator = &pool;
+            thread.setStack(options);
+            thread.run(inspect);
+            thread.join();
+            void* first_stack = observed_address.load();
+            if( (observed_size.load() != stack_size) || !resident.load() ) { return false; }
+            thread.run(inspect);
+            thread.join();
+            if( observed_address.load() != first_stack ) { return false; }
+
+            StackPool small_pool(static_cast<size_t>(PTHREAD_STACK_MIN) / 2);
+            options.allocator = &small_pool;
+            thread.setStack(options);
+            if( thread.run(inspect) ) { return false; }
+
+            CountingStackAllocator counting(pool);
+            options.allocator = &counting;
+            {
+                Thread detached("test_detached");
+                detached.setStack(options);
+                detached.run([]() {});
+                detached.detach();
+            }
+            //the stack is handed back by the start of the next thread with an allocator
+            options.allocator = &pool;
+            thread.setStack(options);
+            for(int i = 0; (i < 100) && (counting.deallocations.load() == 0); ++i)
+            {
+                sleepFor(1);
+                thread.run([]() {});
+                thread.join();
+            }
+            return counting.deallocations.load() == 1;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#include "loop_thread.h"
+#include "blocking_queue.h"
+#include "condition_mutex.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does LoopThread::stop() interrupt a BlockingQueue::pop() without timeout?
+         * 2. Does Thread::requestStop() interrupt ConditionMutex::wait() and leave the mutex usable?
+         */
+        bool test_stop()
+        {
+            BlockingQueue<uint32_t> queue;
+            std::atomic_uint32_t popped(0);
+            LoopThread loop("test_stop0");
+            loop.start([&queue, &popped](const StopToken& token)
+            {
+                if( queue.pop(token) ) { ++popped; }
+                return true;
+            });
+            queue.push(1);
+            sleepFor(100);
+            auto begin = std::chrono::steady_clock::now();
+            loop.stop(true);
+            if( (popped.load() != 1) || (std::chrono::steady_clock::now() - begin > std::chrono::milliseconds(500)) )
+            { return false; }
+
+            ConditionMutex condition;
+            std::atomic_bool interrupted(false);
+            binary_semaphore_t thread_start_event;
+            Thread th("test_stop1");
+            th.run([&condition, &interrupted, &thread_start_event]()
+            {
+                std::lock_guard<ConditionMutex> guard(condition);
+                thread_start_event.post();
+                interrupted.store(!condition.wait(currentStopToken()));
+            });
+            thread_start_event.wait();
+            sleepFor(100);
+            th.requestStop();
+            th.join();
+            std::lock_guard<ConditionMutex> guard(condition);
+            return interrupted.load();
+        }
+    }
+}
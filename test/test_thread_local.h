@@ -0,0 +1,58 @@
+#include "thread_local.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does ShardedCounter::sum() include the increments of live and exited threads exactly once?
+         * 2. Does every thread get its own ThreadLocal value and is it retired when the thread exits?
+         * 3. Are the slots of a cancelled Thread retired?
+         */
+        bool test_thread_local()
+        {
+            const uint32_t thread_count = 4;
+            const int64_t increments = 100000;
+            ShardedCounter counter;
+            std::atomic_uint32_t exited_values(0);
+            ThreadLocal<uint32_t> local([&exited_values](uint32_t& value) { exited_values += value; });
+            binary_semaphore_t started;
+
+            std::vector<std::unique_ptr<Thread>> threads;
+            for(uint32_t i = 0; i < thread_count; ++i)
+            {
+                threads.emplace_back(new Thread("test_tls"));
+                threads.back()->run([&counter, &local, increments]()
+                {
+                    for(int64_t n = 0; n < increments; ++n) { counter.increment(); }
+                    ++local.local();
+                });
+            }
+            for(auto& thread : threads) { thread->join(); }
+            counter.add(5);
+
+            Thread cancelled("test_tls_c");
+            cancelled.run([&counter, &local, &started]()
+            {
+                counter.increment();
+                ++local.local();
+                started.post();
+                while( true ) { sleepFor(10); testCancel(); }
+            });
+            started.wait();
+            cancelled.cancel();
+            cancelled.join();
+
+            uint32_t live_slots = 0;
+            local.for_each([&live_slots](const uint32_t&) { ++live_slots; });
+            return (counter.sum() == thread_count * increments + 5 + 1) && (exited_values.load() == thread_count + 1) && (live_slots == 0);
+        }
+    }
+}
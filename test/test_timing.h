@@ -0,0 +1,73 @@
+#include "thread.h"
+#include "blocking_queue.h"
+#include "condition_mutex.h"
+
+#include <stdint.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <sys/prctl.h>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does sleepUntil() with a spin tail return neither before nor long after the deadline?
+         * 2. Do the std::chrono timeouts of Semaphore, BlockingQueue, BlockingSlot and ConditionMutex expire?
+         * 3. Is the timer slack of a Thread applied, before run() and to the running thread (if CAP_SYS_NICE is held)?
+         */
+        bool test_timing()
+        {
+            using namespace std::chrono;
+            const steady_clock::time_point deadline = steady_clock::now() + microseconds(300);
+            sleepUntil(deadline, microseconds(100));
+            const steady_clock::time_point woken = steady_clock::now();
+            if( (woken < deadline) || (woken - deadline > milliseconds(20)) ) { return false; }
+
+            semaphore_t semaphore;
+            semaphore.post(1);
+            if( semaphore.wait_for(2, microseconds(500)) || semaphore.wait_until(2, steady_clock::now() + microseconds(500)) ) { return false; }
+            if( !semaphore.wait_for(microseconds(500)) || semaphore.wait_until(steady_clock::now() + microseconds(500)) ) { return false; }
+
+            BlockingQueue<int> queue;
+            if( queue.pop(microseconds(500)) || queue.pop_until(steady_clock::now() + microseconds(500)) ) { return false; }
+            queue.push(1);
+            if( queue.pop(microseconds(500)) != 1 ) { return false; }
+
+            BlockingSlot<int> slot;
+            if( slot.get(microseconds(500)) ) { return false; }
+
+            ConditionMutex condition;
+            condition.lock();
+            bool waken = condition.wait_for(microseconds(500));
+            condition.unlock();
+            if( waken ) { return false; }
+
+            std::atomic_bool slack_applied(false);
+            Thread thread("test_timing");
+            thread.setTimerSlack(1000);
+            thread.run([&slack_applied]() { slack_applied.store(prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0) == 1000); });
+            thread.join();
+            if( !slack_applied.load() ) { return false; }
+
+            std::atomic_bool started(false);
+            std::atomic_bool slack_set(false);
+            slack_applied.store(false);
+            thread.run([&]()
+            {
+                started.store(true);
+                while( !slack_set.load() ) { sleepFor(1); }
+                slack_applied.store(prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0) == 2000);
+            });
+            while( !started.load() ) { sleepFor(1); }
+            const bool set = thread.setTimerSlack(2000);
+            //changing the slack of another thread needs CAP_SYS_NICE
+            const bool permitted = set || (errno != EPERM);
+            slack_set.store(true);
+            thread.join();
+            return permitted ? (set && slack_applied.load()) : !slack_applied.load();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#include "trace.h"
+#include "thread.h"
+#include "blocking_queue.h"
+
+#include <stdio.h>
+#include <string>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does the Chrome trace contain a thread_name record labeled with the name of the Thread?
+         * 2. Are the explicit instant and counter events of the thread dumped?
+         * 3. Are the built-in push and pop events of BlockingQueue recorded if tracing is compiled in?
+         */
+        bool test_trace()
+        {
+            Tracer::clear();
+            BlockingQueue<int> queue;
+            Thread producer("test_trace");
+            producer.run([&queue]()
+            {
+                Tracer::instant("test_trace::instant");
+                Tracer::counter("test_trace::counter", 42);
+                queue.push(1);
+            });
+            const bool popped = (queue.pop(1000) == 1);
+            producer.join();
+
+            FILE* out = tmpfile();
+            if( !out ) { return false; }
+            Tracer::writeChromeTrace(out);
+            std::string json(static_cast<size_t>(ftell(out)), '\0');
+            rewind(out);
+            const bool read = (fread(&json[0], 1, json.size(), out) == json.size());
+            fclose(out);
+            if( !popped || !read ) { return false; }
+
+            auto contains = [&json](const char* text) { return json.find(text) != std::string::npos; };
+            if( !contains("\"name\":\"thread_name\"") || !contains("{\"name\":\"test_trace\"}") ) { return false; }
+            if( !contains("\"name\":\"test_trace::instant\",\"ph\":\"i\"") || !contains("\"args\":{\"value\":42}") ) { return false; }
+#ifdef THREAD_UTILS_TRACING
+            if( !contains("\"name\":\"BlockingQueue::push\"") || !contains("\"name\":\"BlockingQueue::pop\"") ) { return false; }
+#endif
+            return (json.compare(0, 15, "{\"traceEvents\":") == 0) && contains("],\"displayTimeUnit\":\"ns\"}");
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include "watchdog.h"
+#include "loop_thread.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Is an iteration running longer than its budget reported once with the name and tid of the loop?
+         * 2. Is the stack of the stalled thread captured?
+         * 3. Are loops making progress left alone?
+         */
+        bool test_watchdog()
+        {
+            std::atomic_uint32_t stalled_reports(0);
+            std::atomic_uint32_t healthy_reports(0);
+            std::atomic_bool stack_captured(false);
+            Watchdog watchdog([&](const StallInfo& stall)
+            {
+                if( stall.name == "test_stalled" ) { ++stalled_reports; }
+                else { ++healthy_reports; }
+                stack_captured.store((stall.tid > 0) && !stall.stack.empty());
+            }, std::chrono::milliseconds(10));
+            watchdog.setStackCapture(true);
+
+            LoopThread stalled("test_stalled");
+            LoopThread healthy("test_healthy");
+            watchdog.watch(stalled, std::chrono::milliseconds(50));
+            watchdog.watch(healthy, std::chrono::milliseconds(50));
+            watchdog.start();
+
+            std::atomic_uint32_t iterations(0);
+            stalled.start([&iterations](std::atomic_bool&)
+            {
+                ++iterations;
+                sleepFor((iterations.load() == 1) ? 300 : 1);
+                return true;
+            });
+            healthy.start([](std::atomic_bool&) { sleepFor(5); return true; });
+            sleepFor(400);
+            stalled.stop(true);
+            healthy.stop(true);
+            watchdog.stop();
+            return (stalled_reports.load() == 1) && (healthy_reports.load() == 0) && stack_captured.load();
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <atomic>
+
+namespace thread_utils
+{
+    namespace tests
+    {
+        /**
+         * Tests:
+         * 1. Does a burst of slow jobs grow the pool above the minimum but not above the maximum?
+         * 2. Do the extra workers retire after lingering, back to the minimum?
+         * 3. Are the queued jobs executed on stop and is submit rejected afterwards?
+         */
+        bool test_worker_pool()
+        {
+            WorkerPoolOptions options;
+            options.minWorkers = 1;
+            options.maxWorkers = 4;
+            options.depthThreshold = 2;
+            options.sojournThreshold = std::chrono::microseconds(500);
+            options.linger = std::chrono::milliseconds(50);
+            options.growCooldown = std::chrono::milliseconds(1);
+            WorkerPool pool("test_pool", options);
+
+            const uint64_t job_count = 200;
+            std::atomic<uint64_t> done(0);
+            for(uint64_t i = 0; i < job_count; ++i)
+            {
+                pool.submit([&done]() { sleepFor(1); done.fetch_add(1); });
+            }
+            while( done.load() < job_count ) { sleepFor(1); }
+            WorkerPoolMetrics metrics = pool.metrics();
+            if( (metrics.peakWorkers < 2) || (metrics.peakWorkers > options.maxWorkers) ) { return false; }
+            if( metrics.growthsByDepth + metrics.growthsBySojourn == 0 ) { return false; }
+
+            for(int i = 0; (i < 100) && (pool.metrics().workers > options.minWorkers); ++i) { sleepFor(10); }
+            metrics = pool.metrics();
+            if( (metrics.workers != options.minWorkers) || (metrics.retired != metrics.spawned - options.minWorkers) ) { return false; }
+
+            for(uint64_t i = 0; i < job_count; ++i) { pool.submit([&done]() { done.fetch_add(1); }); }
+            pool.stop();
+            return (done.load() == 2 * job_count) && (pool.metrics().executed == 2 * job_count) && !pool.submit([]() {});
+        }
+    }
+}